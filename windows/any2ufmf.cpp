@@ -2,13 +2,23 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
 #include <shobjidl.h>     // for IFileDialogEvents and IFileDialogControlEvents
 #include <objbase.h>      // For COM headers
+#endif
+
+#include "winCompat.h"
 
 #include "cv.h"
 #include "highgui.h"
 #include "ufmfWriter.h"
-#include "previewVideo.h"
+#include "previewWindow.h"
+#include "frameSource.h"
+#include "rawFrameSource.h"
+#include "decodeAhead.h"
+#include "arenaMask.h"
+#include "grayConvert.h"
+#include "transcode.h"
 
 typedef enum {
     DialogTypeInput,
@@ -17,18 +27,105 @@ typedef enum {
 
 bool ChooseFile(char fileName[], const char dialogTitle[], const COMDLG_FILTERSPEC filterSpec[], int nFilters, DialogType dialogType);
 bool ChooseFile(char fileName[], const char dialogTitle[], const COMDLG_FILTERSPEC filterSpec[], int nFilters, DialogType dialogType, char defaultFileName[]);
+bool ReadROIParam(const char fileName[], CvRect &roi);
+bool OptionTakesValue(const char * option);
 
 int main(int argc, char * argv[])
 {
-	bool interactiveMode = argc <= 3;
+    // options start with "--" and may appear anywhere; everything else is positional
+    int decodeAheadDepth = DECODEAHEADDEPTH;
+    bool headless = false;
+    bool nativeAVI = true;
+    int nChunks = 1;
+    // raw gray frames of this size from stdin or a pipe instead of a video
+    unsigned int rawW = 0, rawH = 0;
+    bool rawTimestamps = false;
+    // part of each frame to compress, if given on the command line
+    bool roiGiven = false;
+    CvRect roi = cvRect(0,0,0,0);
+    // image whose nonzero pixels are the arena
+    const char * maskFileName = NULL;
+    int nArgs = 1;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i],"--headless") == 0){
+            headless = true;
+        }
+        else if(strcmp(argv[i],"--highgui") == 0){
+            // read every video through highgui, even those the native reader handles
+            nativeAVI = false;
+        }
+        else if(strcmp(argv[i],"--decode-ahead") == 0 && i+1 < argc){
+            decodeAheadDepth = atoi(argv[++i]);
+            if(decodeAheadDepth < 1){
+                fprintf(stderr,"Decode-ahead depth must be at least 1. Aborting.\n");
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i],"--chunks") == 0 && i+1 < argc){
+            nChunks = atoi(argv[++i]);
+            if(nChunks < 1){
+                fprintf(stderr,"Number of chunks must be at least 1. Aborting.\n");
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i],"--raw") == 0 && i+1 < argc){
+            if(sscanf(argv[++i],"%ux%u",&rawW,&rawH) != 2 || rawW == 0 || rawH == 0){
+                fprintf(stderr,"Raw frame size must be given as WIDTHxHEIGHT. Aborting.\n");
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i],"--roi") == 0 && i+1 < argc){
+            if(sscanf(argv[++i],"%d,%d,%d,%d",&roi.x,&roi.y,&roi.width,&roi.height) != 4){
+                fprintf(stderr,"Region of interest must be given as X,Y,WIDTH,HEIGHT. Aborting.\n");
+                return 1;
+            }
+            roiGiven = true;
+        }
+        else if(strcmp(argv[i],"--mask") == 0 && i+1 < argc){
+            maskFileName = argv[++i];
+        }
+        else if(strcmp(argv[i],"--raw-timestamps") == 0){
+            // every raw frame is preceded by its timestamp as an 8-byte double
+            rawTimestamps = true;
+        }
+        else if(OptionTakesValue(argv[i])){
+            // only reached when the option is the last argument
+            fprintf(stderr,"Option %s needs a value. Aborting.\n",argv[i]);
+            return 1;
+        }
+        else if(strncmp(argv[i],"--",2) == 0){
+            fprintf(stderr,"Unknown option %s. Aborting.\n",argv[i]);
+            return 1;
+        }
+        else{
+            argv[nArgs++] = argv[i];
+        }
+    }
+    argc = nArgs;
+    if(rawTimestamps && rawW == 0){
+        fprintf(stderr,"--raw-timestamps needs --raw. Aborting.\n");
+        return 1;
+    }
+
+    // headless mode never opens a dialog or a window, so it can run unattended
+    // and on machines without a display. file dialogs only exist on Windows
+#ifdef _WIN32
+	bool interactiveMode = !headless && argc <= 3;
+#else
+	bool interactiveMode = false;
+	headless = true;
+#endif
     bool fileChoiceSuccess = true;;
 
-    // first argument is the input AVI
+    // first argument is the input AVI, or - for raw frames on stdin
 	char aviFileName[512];
 	if(argc > 1){
 		strcpy(aviFileName,argv[1]);
         fprintf(stdout,"Input AVI file = %s\n",aviFileName);
 	}
+	else if(!interactiveMode){
+        aviFileName[0] = '\0';
+	}
 	else{
         const COMDLG_FILTERSPEC aviTypes[] =
         {
@@ -46,8 +143,18 @@ int main(int argc, char * argv[])
     }
 
 	// input avi
-    CvCapture* capture = cvCaptureFromAVI(aviFileName);
-	if(capture==NULL){
+    frameSource * source = NULL;
+    if(rawW > 0){
+        source = new rawFrameSource(rawW, rawH, rawTimestamps);
+        if(!source->open(aviFileName)){
+            delete source;
+            source = NULL;
+        }
+    }
+    else{
+        source = openFrameSource(aviFileName, nativeAVI);
+    }
+	if(source==NULL){
 		if(interactiveMode){
             MessageBox( NULL, "Error reading AVI. Exiting.", NULL, MB_OK );
 		}
@@ -63,6 +170,9 @@ int main(int argc, char * argv[])
 		strcpy(ufmfFileName,argv[2]);
         fprintf(stdout,"Output UFMF file = %s\n",ufmfFileName);
 	}
+	else if(!interactiveMode){
+        ufmfFileName[0] = '\0';
+	}
 	else{
         const COMDLG_FILTERSPEC ufmfTypes[] =
         {
@@ -115,6 +225,9 @@ int main(int argc, char * argv[])
 		strcpy(ufmfParamsFileName,argv[3]);
 		fprintf(stdout,"UFMF Compression Parameters file = %s\n",ufmfParamsFileName);
 	}
+	else if(!interactiveMode){
+		ufmfParamsFileName[0] = '\0';
+	}
 	else{
         int choice = MessageBox( NULL, "Select a custom parameters file?", "Specify parameters?", MB_YESNO );
         if( choice == IDYES ) {
@@ -130,124 +243,172 @@ int main(int argc, char * argv[])
 	}
 
 	// get avi frame size
-	cvQueryFrame(capture); // this call is necessary to get correct capture properties
-	unsigned __int32 frameH = (unsigned __int32) cvGetCaptureProperty(capture, CV_CAP_PROP_FRAME_HEIGHT);
-	unsigned __int32 frameW = (unsigned __int32) cvGetCaptureProperty(capture, CV_CAP_PROP_FRAME_WIDTH);
-	double nFrames = cvGetCaptureProperty(capture, CV_CAP_PROP_FRAME_COUNT);
-	fprintf(stderr,"Number of frames in the video: %f\n",nFrames);
+	UINT32 frameH = source->getHeight();
+	UINT32 frameW = source->getWidth();
+	UINT64 nFrames = source->getFrameCount();
+	fprintf(stderr,"Reading video with the %s reader\n",source->getName());
+	fprintf(stderr,"Number of frames in the video: %lu\n",(unsigned long) nFrames);
+
+	// only the region of interest is converted and compressed. --roi wins over
+	// UFMFROI in the parameters file
+	if(!roiGiven && (strlen(ufmfParamsFileName) == 0 || !ReadROIParam(ufmfParamsFileName, roi))){
+		roi = cvRect(0,0,frameW,frameH);
+	}
+	if(roi.x < 0 || roi.y < 0 || roi.width < 1 || roi.height < 1 ||
+		(UINT32) (roi.x + roi.width) > frameW || (UINT32) (roi.y + roi.height) > frameH){
+		fprintf(stderr,"Region of interest %d,%d,%d,%d is not inside the %ux%u frame. Aborting.\n",
+			roi.x,roi.y,roi.width,roi.height,frameW,frameH);
+		delete source;
+		return 1;
+	}
+
+	// pixels outside the arena mask are blanked, and the region of interest
+	// shrinks to the part of it the arena covers
+	arenaMask * mask = NULL;
+	if(maskFileName != NULL){
+		mask = new arenaMask();
+		if(!mask->open(maskFileName, frameW, frameH)){
+			fprintf(stderr,"Error reading arena mask. Aborting.\n");
+			delete mask;
+			delete source;
+			return 1;
+		}
+		CvRect bounds = mask->getBounds();
+		int x0 = roi.x > bounds.x ? roi.x : bounds.x;
+		int y0 = roi.y > bounds.y ? roi.y : bounds.y;
+		int x1 = roi.x + roi.width < bounds.x + bounds.width ? roi.x + roi.width : bounds.x + bounds.width;
+		int y1 = roi.y + roi.height < bounds.y + bounds.height ? roi.y + roi.height : bounds.y + bounds.height;
+		if(x1 <= x0 || y1 <= y0){
+			fprintf(stderr,"The arena mask does not overlap the region of interest. Aborting.\n");
+			delete mask;
+			delete source;
+			return 1;
+		}
+		roi = cvRect(x0,y0,x1-x0,y1-y0);
+		mask->setROI(roi);
+	}
+	if((UINT32) roi.width != frameW || (UINT32) roi.height != frameH){
+		fprintf(stderr,"Compressing the %dx%d region of interest at %d,%d\n",roi.width,roi.height,roi.x,roi.y);
+	}
 
 	// log file
 	//FILE * logFID = fopen("C:\\Code\\imaq\\any2ufmf\\out\\log.txt","w");
 	FILE * logFID = stderr;
 
+	double frameRate = 1.0/30.0;
+
+	fprintf(stderr,"Gray conversion kernel: %s\n",grayConvertKernelName(grayConvertKernel()));
+
+	// convert stretches of the video in parallel and stitch them together.
+	// there is no preview in this mode
+	if(nChunks > 1){
+		if(nFrames == 0){
+			fprintf(stderr,"Number of frames is unknown, cannot split the video into chunks\n");
+			delete source;
+			if(mask != NULL){
+				delete mask;
+			}
+			return 1;
+		}
+		bool success = transcodeInChunks(aviFileName, ufmfFileName, ufmfParamsFileName, nativeAVI, roi, mask,
+			nFrames, nChunks, decodeAheadDepth, frameRate, logFID);
+		if(!success){
+			fprintf(stderr,"Error converting in chunks\n");
+		}
+		delete source;
+		if(mask != NULL){
+			delete mask;
+		}
+		if(interactiveMode){
+			fprintf(stderr,"Hit enter to exit\n");
+			getc(stdin);
+		}
+		return success ? 0 : 1;
+	}
+
+	// every failure from here on goes through the clean up below, so that the
+	// threads are stopped, the ufmf gets its index and everything is freed
+	bool success = true;
+	previewWindow * preview = NULL;
+	decodeAhead * decoder = NULL;
+
 	// output ufmf
-	ufmfWriter * writer = new ufmfWriter(ufmfFileName, frameW, frameH, logFID, ufmfParamsFileName);
-	if(!writer->startWrite()){
+	ufmfWriter * writer = new ufmfWriter(ufmfFileName, roi.width, roi.height, logFID, ufmfParamsFileName);
+	bool writing = writer->startWrite();
+	if(!writing){
 		if(interactiveMode){
             MessageBox( NULL, "Error initializing uFMF writer. Exiting.", NULL, MB_OK );
 		}
         else {
             fprintf(stderr,"Error starting write\n");
         }
-		return 1;
+		success = false;
 	}
 
 	// start preview thread
-	HANDLE lock = CreateSemaphore(NULL,1,1,NULL);
-	previewVideo * preview = new previewVideo(lock);
-
-    IplImage * frame = NULL;
-	unsigned __int64 frameNumber;
-	IplImage * frameWrite = NULL;
-	IplImage * grayFrame = cvCreateImage(cvSize(frameW,frameH),IPL_DEPTH_8U,1);
-
-    double timestamp;
-	double frameRate = 1.0/30.0;
-
-	fprintf(stderr,"Hit esc to stop playing\n");
-	bool DEBUGFAST = false;
-	for(frameNumber = 0, timestamp = 0.; ; frameNumber++, timestamp += frameRate){
-
-		if(DEBUGFAST && frameNumber >= 3000)
-			break;
-
-		if((frameNumber % 100) == 0){
-			fprintf(stderr,"** frame %lu\n",frameNumber);
+	if(success && !headless){
+		preview = new previewWindow("any2ufmf");
+		if(!preview->start()){
+			success = false;
 		}
+	}
 
-		if(!DEBUGFAST && (WaitForSingleObject(lock, MAXWAITTIMEMS) != WAIT_OBJECT_0)) { 
-			fprintf(stderr,"Error waiting for preview thread to unlock\n");
-			break;
-		}
-		if(!DEBUGFAST || (frame == NULL))
-			frame = cvQueryFrame(capture);
-		//frameNumber++;
-		if(!DEBUGFAST) ReleaseSemaphore(lock,1,NULL);
-		if(!frame){
-			fprintf(stderr,"Last frame read = %d\n",frameNumber);
-			break;
-		}
-		if(!DEBUGFAST && !preview->setFrame(frame,frameNumber)){
-			break;
-		}
-		
-		if(!DEBUGFAST || frameWrite == NULL){
-			if(frame->nChannels > 1){
-				cvCvtColor(frame,grayFrame,CV_RGB2GRAY);
-				frameWrite = grayFrame;
-			}
-			else{
-				frameWrite = frame;
-			}
+	// decode on a separate thread so that decoding overlaps with compression
+	if(success){
+		decoder = new decodeAhead(source, roi, decodeAheadDepth, preview);
+		decoder->setMask(mask);
+		if(!decoder->start()){
+			fprintf(stderr,"Error starting decoder\n");
+			success = false;
 		}
-		if(!writer->addFrame((unsigned char*) frameWrite->imageData,timestamp)){
-			fprintf(stderr,"Error adding frame %d\n",frameNumber);
-			break;
-		}
-
 	}
 
-	if(!writer->stopWrite()){
-		fprintf(stderr,"Error stopping writing\n");
-		if(interactiveMode){
-			fprintf(stderr,"Hit enter to exit\n");
-			getc(stdin);
+	if(success){
+		if(preview != NULL){
+			fprintf(stderr,"Hit esc to stop playing\n");
 		}
-		return 1;
+		UINT64 endFrame;
+		success = transcodeFrames(decoder, writer, frameRate, endFrame);
 	}
 
-	if(!preview->stop()){
-		fprintf(stderr,"Error waiting for preview thread to unlock\n");
+	// clean up
+	if(decoder != NULL && !decoder->stop()){
+		fprintf(stderr,"Error stopping decoder\n");
+		success = false;
+	}
+	if(writing && !writer->stopWrite()){
+		fprintf(stderr,"Error stopping writing\n");
+		success = false;
+	}
+	if(preview != NULL && !preview->stop()){
+		fprintf(stderr,"Error stopping preview thread\n");
 	}
 
-	// clean up
+	if(decoder != NULL){
+		delete decoder;
+		decoder = NULL;
+	}
 	if(preview != NULL){
 		delete preview;
 		preview = NULL;
 	}
-	if(lock){
-		CloseHandle(lock);
-		lock = NULL;
-	}
-	if(capture != NULL){
-		cvReleaseCapture(&capture);
-		capture = NULL;
-		frame = NULL;
-	}
-	if(grayFrame != NULL){
-		cvReleaseImage(&grayFrame);
-		grayFrame = NULL;
+	if(source != NULL){
+		delete source;
+		source = NULL;
 	}
 	if(writer != NULL){
 		delete writer;
 	}
+	if(mask != NULL){
+		delete mask;
+	}
 
 	if(interactiveMode){
 		fprintf(stderr,"Hit enter to exit\n");
 		getc(stdin);
 	}
 
-	return 0;
+	return success ? 0 : 1;
 }
 
 
@@ -258,6 +419,11 @@ bool ChooseFile(char fileName[], const char dialogTitle[], const COMDLG_FILTERSP
 
 bool ChooseFile(char fileName[], const char dialogTitle[], const COMDLG_FILTERSPEC filterSpec[], int nFilters, DialogType dialogType, char defaultFileName[])
 {
+#ifndef _WIN32
+    fprintf(stderr,"File dialogs are only available on Windows\n");
+    *fileName = 0;
+    return false;
+#else
 	HRESULT hr;
 
     hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
@@ -370,4 +536,42 @@ bool ChooseFile(char fileName[], const char dialogTitle[], const COMDLG_FILTERSP
     }
 
 	return SUCCEEDED( hr );
+#endif
+}
+
+// reads "UFMFROI = X,Y,WIDTH,HEIGHT" from the compression parameters file.
+// returns false if the file has no such line
+bool ReadROIParam(const char fileName[], CvRect &roi)
+{
+	FILE * fp = fopen(fileName,"r");
+	if(fp == NULL){
+		return false;
+	}
+	bool found = false;
+	char line[512];
+	while(!found && fgets(line,sizeof(line),fp) != NULL){
+		char * p = line;
+		while(*p == ' ' || *p == '\t') p++;
+		if(strncmp(p,"UFMFROI",7) != 0 || (p[7] != ' ' && p[7] != '\t' && p[7] != '=')){
+			continue;
+		}
+		p = strchr(p,'=');
+		found = p != NULL && sscanf(p+1,"%d,%d,%d,%d",&roi.x,&roi.y,&roi.width,&roi.height) == 4;
+	}
+	fclose(fp);
+	return found;
+}
+
+// options that are followed by a value
+bool OptionTakesValue(const char * option)
+{
+	static const char * valueOptions[] = {
+		"--decode-ahead", "--chunks", "--raw", "--roi", "--mask"
+	};
+	for(size_t i = 0; i < ARRAYSIZE(valueOptions); i++){
+		if(strcmp(option,valueOptions[i]) == 0){
+			return true;
+		}
+	}
+	return false;
 }
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "highgui.h"
+#include "arenaMask.h"
+
+arenaMask::arenaMask()
+{
+	mask = NULL;
+	bounds = cvRect(0,0,0,0);
+	roi = cvRect(0,0,0,0);
+}
+
+arenaMask::~arenaMask()
+{
+	if(mask != NULL){
+		cvReleaseImage(&mask);
+	}
+}
+
+bool arenaMask::open(const char * fileName, UINT32 frameW, UINT32 frameH)
+{
+	mask = cvLoadImage(fileName,CV_LOAD_IMAGE_GRAYSCALE);
+	if(mask == NULL){
+		fprintf(stderr,"Error reading mask %s\n",fileName);
+		return false;
+	}
+	if((UINT32) mask->width != frameW || (UINT32) mask->height != frameH){
+		fprintf(stderr,"Mask %s is %dx%d, the video is %ux%u\n",fileName,mask->width,mask->height,frameW,frameH);
+		cvReleaseImage(&mask);
+		return false;
+	}
+
+	int x0 = mask->width, x1 = -1, y0 = mask->height, y1 = -1;
+	for(int y = 0; y < mask->height; y++){
+		const unsigned char * row = (const unsigned char*) mask->imageData + (size_t) y * mask->widthStep;
+		for(int x = 0; x < mask->width; x++){
+			if(row[x] != 0){
+				if(x < x0) x0 = x;
+				if(x > x1) x1 = x;
+				if(y < y0) y0 = y;
+				y1 = y;
+			}
+		}
+	}
+	if(x1 < 0){
+		fprintf(stderr,"Mask %s is empty\n",fileName);
+		cvReleaseImage(&mask);
+		return false;
+	}
+	bounds = cvRect(x0,y0,x1-x0+1,y1-y0+1);
+	setROI(cvRect(0,0,mask->width,mask->height));
+	return true;
+}
+
+void arenaMask::setROI(CvRect roi)
+{
+	this->roi = roi;
+	spans.clear();
+	rowSpans.assign(1,0);
+	for(int y = 0; y < roi.height; y++){
+		const unsigned char * row = (const unsigned char*) mask->imageData + (size_t) (roi.y + y) * mask->widthStep + roi.x;
+		int x = 0;
+		while(x < roi.width){
+			while(x < roi.width && row[x] != 0) x++;
+			int start = x;
+			while(x < roi.width && row[x] == 0) x++;
+			if(x > start){
+				spans.push_back(start);
+				spans.push_back(x);
+			}
+		}
+		rowSpans.push_back((int) spans.size());
+	}
+}
+
+void arenaMask::fill(IplImage * frame, unsigned char value) const
+{
+	for(int y = 0; y < frame->height; y++){
+		unsigned char * row = (unsigned char*) frame->imageData + (size_t) y * frame->widthStep;
+		for(int i = rowSpans[y]; i < rowSpans[y+1]; i += 2){
+			memset(row + spans[i],value,spans[i+1] - spans[i]);
+		}
+	}
+}
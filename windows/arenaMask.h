@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+#include "winCompat.h"
+
+#include "cv.h"
+
+// arenaMask is a binary image saying which pixels belong to the arena, e.g.
+// a disc for a circular arena. Frames are cropped to the bounding box of the
+// arena, and everything outside the arena is overwritten with a constant, so
+// ufmfWriter sees a background there that never changes and never puts a box
+// on it. The pixels to overwrite are kept as spans per row, so the cost of
+// masking a frame is a memset per span
+class arenaMask {
+
+public:
+
+	arenaMask();
+	~arenaMask();
+
+	// nonzero pixels of the mask image are inside the arena. the mask must
+	// have the size of the video
+	bool open(const char * fileName, UINT32 frameW, UINT32 frameH);
+
+	// smallest rectangle holding the whole arena
+	CvRect getBounds() { return bounds; }
+
+	// frames passed to fill from now on are cropped to roi
+	void setROI(CvRect roi);
+	CvRect getROI() const { return roi; }
+
+	// overwrites the pixels outside the arena with value
+	void fill(IplImage * frame, unsigned char value) const;
+
+private:
+
+	IplImage * mask;
+	CvRect bounds;
+	CvRect roi;
+
+	// spans of pixels outside the arena in row y of the cropped frame are
+	// spans[rowSpans[y]] up to spans[rowSpans[y+1]], each a start and an end
+	std::vector<int> spans;
+	std::vector<int> rowSpans;
+};
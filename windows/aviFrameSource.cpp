@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "aviFrameSource.h"
+
+// OpenDML index types
+#define AVI_INDEX_OF_INDEXES 0x00
+#define AVI_INDEX_OF_CHUNKS 0x01
+// set in the size of an OpenDML index entry for frames that are not keyframes
+#define AVI_INDEX_DELTAFRAME 0x80000000
+
+// AVI fields are little-endian and not necessarily aligned
+static unsigned short readU16(const unsigned char * p)
+{
+	unsigned short v;
+	memcpy(&v,p,2);
+	return v;
+}
+
+static UINT32 readU32(const unsigned char * p)
+{
+	UINT32 v;
+	memcpy(&v,p,4);
+	return v;
+}
+
+static UINT64 readU64(const unsigned char * p)
+{
+	UINT64 v;
+	memcpy(&v,p,8);
+	return v;
+}
+
+static bool isFourcc(const unsigned char * p, const char * fourcc)
+{
+	return memcmp(p,fourcc,4) == 0;
+}
+
+aviFrameSource::aviFrameSource()
+{
+	width = 0;
+	height = 0;
+	nChannels = 0;
+	bottomUp = false;
+	frameBytes = 0;
+	rowBytes = 0;
+	streamCount = 0;
+	streamNumber = -1;
+	streamId[0] = streamId[1] = 0;
+	usePalette = false;
+	isMJPEG = false;
+	grayFrame = NULL;
+	nextFrameIndex = 0;
+	truncated = false;
+	readError = false;
+	superIndex = NULL;
+	superIndexSize = 0;
+	idx1Offset = 0;
+	idx1Size = 0;
+}
+
+aviFrameSource::~aviFrameSource()
+{
+	if(grayFrame != NULL){
+		cvReleaseImage(&grayFrame);
+	}
+	file.close();
+}
+
+bool aviFrameSource::open(const char * fileName)
+{
+	if(!file.open(fileName)){
+		return false;
+	}
+	const unsigned char * data = file.getData();
+	UINT64 size = file.getSize();
+	if(size < 12 || !isFourcc(data,"RIFF") || !isFourcc(data+8,"AVI ")){
+		return false;
+	}
+
+	// files over 1 GB continue in further RIFF AVIX lists (OpenDML)
+	UINT64 pos = 0;
+	while(pos + 12 <= size && isFourcc(data+pos,"RIFF")){
+		UINT64 end = pos + 8 + readU32(data+pos+4);
+		if(end > size) end = size;
+		if(!parseHeaders(pos+12,end)){
+			return false;
+		}
+		pos = end + (end & 1);
+	}
+	if(streamNumber < 0 || frameBytes == 0){
+		return false;
+	}
+
+	if(superIndex == NULL || !readSuperIndex(superIndex,superIndexSize)){
+		frames.clear();
+		// idx1 only covers the first RIFF list, the rest is scanned
+		size_t firstScanned = 0;
+		if(idx1Offset != 0 && readIdx1()){
+			firstScanned = 1;
+		}
+		else{
+			frames.clear();
+		}
+		for(size_t i = firstScanned; i < moviLists.size() && !truncated; i++){
+			scanMovi(moviLists[i],moviEnds[i]);
+		}
+	}
+	if(frames.empty()){
+		return false;
+	}
+
+	cvInitImageHeader(&header,cvSize(width,height),IPL_DEPTH_8U,nChannels,bottomUp ? IPL_ORIGIN_BL : IPL_ORIGIN_TL,4);
+	header.widthStep = rowBytes;
+	header.imageSize = frameBytes;
+	if(decodesToGray()){
+		grayFrame = cvCreateImage(cvSize(width,height),IPL_DEPTH_8U,1);
+	}
+	// MJPEG that mjpegDecoder cannot handle, e.g. progressive, goes to the
+	// next reader
+	if(isMJPEG && !nextFrameInto(grayFrame)){
+		return false;
+	}
+	nextFrameIndex = 0;
+	readError = false;
+	return true;
+}
+
+bool aviFrameSource::parseHeaders(UINT64 pos, UINT64 end)
+{
+	const unsigned char * data = file.getData();
+
+	while(pos + 8 <= end){
+		const unsigned char * chunk = data + pos;
+		UINT32 chunkSize = readU32(chunk+4);
+		UINT64 chunkEnd = pos + 8 + chunkSize;
+		// a recording that was cut off ends in a truncated chunk
+		if(chunkEnd > end){
+			chunkEnd = end;
+			chunkSize = (UINT32) (end - pos - 8);
+		}
+
+		if(isFourcc(chunk,"LIST") && chunkSize >= 4){
+			const unsigned char * listType = chunk + 8;
+			if(isFourcc(listType,"movi")){
+				moviLists.push_back(pos+12);
+				moviEnds.push_back(chunkEnd);
+			}
+			else if(isFourcc(listType,"hdrl")){
+				if(!parseHeaders(pos+12,chunkEnd)) return false;
+			}
+			else if(isFourcc(listType,"strl")){
+				// strh comes first in each strl and says what kind of stream it is
+				int stream = streamCount;
+				const unsigned char * strh = NULL;
+				const unsigned char * strf = NULL;
+				const unsigned char * indx = NULL;
+				UINT32 strfSize = 0, indxSize = 0;
+				UINT64 p = pos + 12;
+				while(p + 8 <= chunkEnd){
+					UINT32 s = readU32(data+p+4);
+					if(p + 8 + s > chunkEnd) break;
+					if(isFourcc(data+p,"strh") && s >= 4) strh = data + p + 8;
+					else if(isFourcc(data+p,"strf")){ strf = data + p + 8; strfSize = s; }
+					else if(isFourcc(data+p,"indx")){ indx = data + p + 8; indxSize = s; }
+					p += 8 + s + (s & 1);
+				}
+				streamCount++;
+				if(streamNumber < 0 && strh != NULL && isFourcc(strh,"vids")){
+					if(strf == NULL || stream > 99 || !parseStreamFormat(strf,strfSize)){
+						return false;
+					}
+					streamNumber = stream;
+					streamId[0] = (char) ('0' + stream / 10);
+					streamId[1] = (char) ('0' + stream % 10);
+					superIndex = indx;
+					superIndexSize = indxSize;
+				}
+			}
+		}
+		else if(isFourcc(chunk,"idx1") && idx1Offset == 0){
+			idx1Offset = pos + 8;
+			idx1Size = chunkSize;
+		}
+		pos = chunkEnd + (chunkEnd & 1);
+	}
+	return true;
+}
+
+bool aviFrameSource::parseStreamFormat(const unsigned char * strf, UINT32 size)
+{
+	// BITMAPINFOHEADER, followed by the palette for 8-bit DIBs
+	if(size < 40){
+		return false;
+	}
+	UINT32 biSize = readU32(strf);
+	INT32 biWidth = (INT32) readU32(strf+4);
+	INT32 biHeight = (INT32) readU32(strf+8);
+	unsigned short biBitCount = readU16(strf+14);
+	const unsigned char * biCompression = strf + 16;
+	UINT32 biClrUsed = readU32(strf+32);
+	if(biWidth <= 0 || biHeight == 0 || biSize < 40){
+		return false;
+	}
+	width = (UINT32) biWidth;
+	height = (UINT32) (biHeight < 0 ? -biHeight : biHeight);
+	if(width > 65535 || height > 65535){
+		return false;
+	}
+
+	if(readU32(biCompression) == 0){
+		// BI_RGB: rows are padded to 4 bytes and stored bottom-up unless the
+		// height is negative
+		if(biBitCount == 24) nChannels = 3;
+		else if(biBitCount == 8) nChannels = 1;
+		else return false;
+		rowBytes = (int) ((width * nChannels + 3) & ~3);
+		bottomUp = biHeight > 0;
+
+		if(nChannels == 1){
+			// gray the way highgui followed by CV_RGB2GRAY made it, with
+			// channel 0 (blue in a palette) weighted as red
+			UINT32 nColors = biClrUsed != 0 ? biClrUsed : 256;
+			UINT32 nStored = size > biSize ? (size - biSize) / 4 : 0;
+			if(nColors > nStored) nColors = nStored;
+			const unsigned char * palette = strf + biSize;
+			usePalette = false;
+			for(int i = 0; i < 256; i++){
+				if((UINT32) i < nColors){
+					const unsigned char * bgr = palette + 4*i;
+					paletteGray[i] = (unsigned char) ((4899*bgr[0] + 9617*bgr[1] + 1868*bgr[2] + 8192) >> 14);
+				}
+				else{
+					paletteGray[i] = (unsigned char) i;
+				}
+				if(paletteGray[i] != i) usePalette = true;
+			}
+		}
+	}
+	else if(isFourcc(biCompression,"MJPG") || isFourcc(biCompression,"mjpg")){
+		isMJPEG = true;
+		nChannels = 1;
+		rowBytes = (int) width;
+		bottomUp = false;
+	}
+	else if(isFourcc(biCompression,"Y800") || isFourcc(biCompression,"Y8  ") || isFourcc(biCompression,"GREY")){
+		if(biBitCount != 8){
+			return false;
+		}
+		nChannels = 1;
+		rowBytes = (int) width;
+		bottomUp = false;
+	}
+	else{
+		return false;
+	}
+
+	if((UINT64) rowBytes * height > 0x7fffffff){
+		return false;
+	}
+	frameBytes = (UINT32) rowBytes * height;
+	return true;
+}
+
+bool aviFrameSource::readSuperIndex(const unsigned char * indx, UINT32 size)
+{
+	const unsigned char * data = file.getData();
+	UINT64 fileSize = file.getSize();
+
+	if(size < 24 || indx[3] != AVI_INDEX_OF_INDEXES || readU16(indx) != 4){
+		return false;
+	}
+	UINT32 nEntries = readU32(indx+4);
+	if(nEntries > (size - 24) / 16){
+		return false;
+	}
+
+	frames.clear();
+	for(UINT32 i = 0; i < nEntries; i++){
+		// each entry points at an ix## chunk listing the frames of one movi list
+		UINT64 ixPos = readU64(indx + 24 + 16*i);
+		if(ixPos + 8 + 24 > fileSize){
+			return false;
+		}
+		const unsigned char * ix = data + ixPos + 8;
+		UINT32 ixSize = readU32(data + ixPos + 4);
+		if(ixSize < 24 || ixPos + 8 + ixSize > fileSize || ix[3] != AVI_INDEX_OF_CHUNKS || readU16(ix) != 2){
+			return false;
+		}
+		UINT32 nChunks = readU32(ix+4);
+		UINT64 baseOffset = readU64(ix+12);
+		if(nChunks > (ixSize - 24) / 8){
+			return false;
+		}
+		for(UINT32 j = 0; j < nChunks; j++){
+			const unsigned char * entry = ix + 24 + 8*j;
+			if(!addFrame(baseOffset + readU32(entry),readU32(entry+4) & ~AVI_INDEX_DELTAFRAME)){
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool aviFrameSource::readIdx1()
+{
+	const unsigned char * data = file.getData();
+	UINT64 fileSize = file.getSize();
+	if(moviLists.empty()){
+		return false;
+	}
+
+	// idx1 offsets point at chunk headers and are usually relative to the
+	// "movi" fourcc, but some writers store absolute file offsets
+	UINT64 base = 0;
+	bool baseKnown = false;
+	UINT32 nEntries = idx1Size / 16;
+	for(UINT32 i = 0; i < nEntries; i++){
+		const unsigned char * entry = data + idx1Offset + 16*i;
+		if(!isFrameChunk(entry)){
+			continue;
+		}
+		UINT64 offset = readU32(entry+8);
+		UINT32 size = readU32(entry+12);
+		if(!baseKnown){
+			UINT64 movi = moviLists[0] - 4;
+			if(movi + offset + 8 <= fileSize && isFourcc(data+movi+offset,(const char*) entry)){
+				base = movi;
+			}
+			else if(offset + 8 <= fileSize && isFourcc(data+offset,(const char*) entry)){
+				base = 0;
+			}
+			else{
+				return false;
+			}
+			baseKnown = true;
+		}
+		if(!addFrame(base + offset + 8,size)){
+			return false;
+		}
+	}
+	return !frames.empty();
+}
+
+void aviFrameSource::scanMovi(UINT64 pos, UINT64 end)
+{
+	const unsigned char * data = file.getData();
+
+	while(pos + 8 <= end){
+		const unsigned char * chunk = data + pos;
+		UINT32 chunkSize = readU32(chunk+4);
+		UINT64 chunkEnd = pos + 8 + chunkSize;
+		if(chunkEnd > end && !isFrameChunk(chunk)){
+			return;
+		}
+		// frames after a bad one cannot be found, so the video is cut short
+		if(isFrameChunk(chunk) && (chunkEnd > end || !addFrame(pos+8,chunkSize))){
+			fprintf(stderr,"Frame chunk at offset %lu is damaged or cut off, the video ends after frame %lu\n",
+				(unsigned long) pos,(unsigned long) frames.size());
+			truncated = true;
+			return;
+		}
+		if(isFourcc(chunk,"LIST") && chunkSize >= 4 && isFourcc(chunk+8,"rec ")){
+			scanMovi(pos+12,chunkEnd);
+			if(truncated){
+				return;
+			}
+		}
+		pos = chunkEnd + (chunkEnd & 1);
+	}
+}
+
+bool aviFrameSource::addFrame(UINT64 offset, UINT32 size)
+{
+	// an empty chunk repeats the previous frame. leading ones are dropped
+	if(size == 0){
+		if(!frames.empty()){
+			frames.push_back(frames.back());
+		}
+		return true;
+	}
+	// compressed frames vary in size
+	UINT32 minSize = isMJPEG ? 1 : frameBytes;
+	if(size < minSize || offset + (isMJPEG ? size : frameBytes) > file.getSize()){
+		return false;
+	}
+	AviFrame frame = {offset,size};
+	frames.push_back(frame);
+	return true;
+}
+
+bool aviFrameSource::isFrameChunk(const unsigned char * fourcc)
+{
+	return fourcc[0] == streamId[0] && fourcc[1] == streamId[1] &&
+		fourcc[2] == 'd' && (fourcc[3] == 'b' || fourcc[3] == 'c');
+}
+
+bool aviFrameSource::seek(UINT64 frameNumber)
+{
+	if(frameNumber > frames.size()){
+		return false;
+	}
+	nextFrameIndex = frameNumber;
+	return true;
+}
+
+bool aviFrameSource::nextFrameInto(IplImage * gray)
+{
+	if(nextFrameIndex >= frames.size()){
+		readError = truncated;
+		return false;
+	}
+	const AviFrame &frame = frames[nextFrameIndex++];
+	const unsigned char * data = file.getData() + frame.offset;
+
+	if(isMJPEG){
+		if(!mjpeg.decode(data,frame.size,(unsigned char*) gray->imageData,gray->widthStep,width,height)){
+			fprintf(stderr,"Error decoding MJPEG frame %lu\n",(unsigned long) (nextFrameIndex - 1));
+			readError = true;
+			return false;
+		}
+		return true;
+	}
+
+	// look up and flip in one pass
+	for(UINT32 y = 0; y < height; y++){
+		const unsigned char * src = data + (size_t) (bottomUp ? height - 1 - y : y) * rowBytes;
+		unsigned char * dst = (unsigned char*) gray->imageData + (size_t) y * gray->widthStep;
+		for(UINT32 x = 0; x < width; x++){
+			dst[x] = paletteGray[src[x]];
+		}
+	}
+	return true;
+}
+
+IplImage * aviFrameSource::nextFrame()
+{
+	if(decodesToGray()){
+		return nextFrameInto(grayFrame) ? grayFrame : NULL;
+	}
+	if(nextFrameIndex >= frames.size()){
+		readError = truncated;
+		return NULL;
+	}
+	header.imageData = (char*) file.getData() + frames[nextFrameIndex++].offset;
+	header.imageDataOrigin = header.imageData;
+	return &header;
+}
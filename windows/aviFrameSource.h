@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+
+#include "frameSource.h"
+#include "mappedFile.h"
+#include "mjpegDecoder.h"
+
+// aviFrameSource reads uncompressed AVIs straight out of a memory mapping of
+// the file, without highgui or a codec. It handles 8-bit paletted and 24-bit
+// BGR DIBs and Y800/Y8/GREY gray, indexed by an OpenDML index, an idx1 index
+// or, failing both, a scan of the movi list. Frames are returned as headers
+// pointing into the mapping, so 8-bit frames reach ufmfWriter with no copy.
+// MJPEG AVIs are read the same way and only their luma is decoded, straight
+// into the frame the writer gets. open fails for anything else, and the
+// caller falls back to the next reader
+class aviFrameSource : public frameSource {
+
+public:
+
+	aviFrameSource();
+	~aviFrameSource();
+
+	bool open(const char * fileName);
+
+	UINT32 getWidth() { return width; }
+	UINT32 getHeight() { return height; }
+	UINT64 getFrameCount() { return frames.size(); }
+	const char * getName() { return "native AVI"; }
+
+	bool seek(UINT64 frameNumber);
+	IplImage * nextFrame();
+	bool framesPersist() { return !decodesToGray(); }
+	bool decodesToGray() { return usePalette || isMJPEG; }
+	bool nextFrameInto(IplImage * gray);
+	bool failed() { return readError; }
+
+private:
+
+	bool parseHeaders(UINT64 pos, UINT64 end);
+	bool parseStreamFormat(const unsigned char * strf, UINT32 size);
+	bool readSuperIndex(const unsigned char * indx, UINT32 size);
+	bool readIdx1();
+	void scanMovi(UINT64 pos, UINT64 end);
+	bool addFrame(UINT64 offset, UINT32 size);
+	bool isFrameChunk(const unsigned char * fourcc);
+
+	mappedFile file;
+
+	UINT32 width;
+	UINT32 height;
+	int nChannels;
+	bool bottomUp;
+	UINT32 frameBytes;
+	int rowBytes;
+
+	// chunk ids of our stream are "nndb" or "nndc", nn its number
+	int streamCount;
+	int streamNumber;
+	char streamId[2];
+
+	// 8-bit frames whose palette is not the identity are mapped to gray
+	// through a lookup table
+	bool usePalette;
+	unsigned char paletteGray[256];
+
+	bool isMJPEG;
+	mjpegDecoder mjpeg;
+
+	// where nextFrame puts frames that nextFrameInto makes
+	IplImage * grayFrame;
+
+	// where the data of each frame is in the file
+	typedef struct {
+		UINT64 offset;
+		UINT32 size;
+	} AviFrame;
+	std::vector<AviFrame> frames;
+	UINT64 nextFrameIndex;
+	IplImage header;
+	// the scan of the movi list stopped at a damaged or cut off frame, so
+	// the frames after it are missing
+	bool truncated;
+	bool readError;
+
+	// collected while parsing the headers
+	const unsigned char * superIndex;
+	UINT32 superIndexSize;
+	std::vector<UINT64> moviLists;
+	std::vector<UINT64> moviEnds;
+	UINT64 idx1Offset;
+	UINT32 idx1Size;
+};
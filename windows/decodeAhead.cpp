@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "decodeAhead.h"
+#include "grayConvert.h"
+
+decodeAhead::decodeAhead(frameSource * source, CvRect roi, int depth, previewWindow * preview)
+{
+	this->source = source;
+	this->preview = preview;
+	this->roi = roi;
+	cropped = roi.x != 0 || roi.y != 0 ||
+		(UINT32) roi.width != source->getWidth() || (UINT32) roi.height != source->getHeight();
+	fullFrame = NULL;
+	mask = NULL;
+	if(cropped && source->decodesToGray()){
+		fullFrame = cvCreateImageHeader(cvSize(source->getWidth(),source->getHeight()),IPL_DEPTH_8U,1);
+	}
+	firstFrame = 0;
+	endFrame = (UINT64) -1;
+	if(depth < 1) depth = 1;
+	this->depth = depth;
+
+	// all frames are allocated up front and reused for the whole video
+	ring = new IplImage*[depth];
+	ringFrames = new IplImage*[depth];
+	ringHeaders = new IplImage[depth];
+	ringFrameNumbers = new UINT64[depth];
+	ringTimestamps = new double[depth];
+	ringTimestamped = new bool[depth];
+	ringEnd = new bool[depth];
+	for(int i = 0; i < depth; i++){
+		// ufmfWriter takes frames whose rows are not padded, and OpenCV pads
+		// rows to 4 bytes, so the rows are packed by hand
+		ring[i] = cvCreateImageHeader(cvSize(roi.width,roi.height),IPL_DEPTH_8U,1);
+		ring[i]->widthStep = roi.width;
+		ring[i]->imageSize = roi.width * roi.height;
+		ringFrames[i] = ring[i];
+		ringFrameNumbers[i] = 0;
+		ringTimestamps[i] = 0;
+		ringTimestamped[i] = false;
+		ringEnd[i] = false;
+	}
+	readIndex = 0;
+	writeIndex = 0;
+	readFailed = false;
+
+	// the pixels of all these frames share one aligned arena. if that much
+	// memory cannot be had in one piece, each frame gets its own
+	size_t arenaSize = depth * frameArena::blockSize(ring[0]->imageSize);
+	if(fullFrame != NULL){
+		arenaSize += frameArena::blockSize(fullFrame->imageSize);
+	}
+	framesInArena = arena.allocate(arenaSize);
+	for(int i = 0; i < depth; i++){
+		setFrameData(ring[i]);
+	}
+	if(fullFrame != NULL){
+		setFrameData(fullFrame);
+	}
+
+	emptySlots = CreateSemaphore(NULL,depth,depth,NULL);
+	fullSlots = CreateSemaphore(NULL,0,depth,NULL);
+	thread = NULL;
+	stopRequested = 0;
+	grayInRGB = true;
+	decoderWaits = 0;
+	writerWaits = 0;
+}
+
+decodeAhead::~decodeAhead()
+{
+	stop();
+	if(emptySlots){
+		CloseHandle(emptySlots);
+		emptySlots = NULL;
+	}
+	if(fullSlots){
+		CloseHandle(fullSlots);
+		fullSlots = NULL;
+	}
+	if(ring != NULL){
+		for(int i = 0; i < depth; i++){
+			releaseFrameData(&ring[i]);
+		}
+		delete [] ring;
+		ring = NULL;
+	}
+	if(ringFrames != NULL){
+		delete [] ringFrames;
+		ringFrames = NULL;
+	}
+	if(ringHeaders != NULL){
+		delete [] ringHeaders;
+		ringHeaders = NULL;
+	}
+	if(ringFrameNumbers != NULL){
+		delete [] ringFrameNumbers;
+		ringFrameNumbers = NULL;
+	}
+	if(ringTimestamps != NULL){
+		delete [] ringTimestamps;
+		ringTimestamps = NULL;
+	}
+	if(ringTimestamped != NULL){
+		delete [] ringTimestamped;
+		ringTimestamped = NULL;
+	}
+	if(ringEnd != NULL){
+		delete [] ringEnd;
+		ringEnd = NULL;
+	}
+	if(fullFrame != NULL){
+		releaseFrameData(&fullFrame);
+	}
+}
+
+void decodeAhead::setFrameData(IplImage * frame)
+{
+	if(framesInArena){
+		cvSetData(frame,arena.take(frame->imageSize),frame->widthStep);
+	}
+	else{
+		cvCreateData(frame);
+	}
+}
+
+void decodeAhead::releaseFrameData(IplImage ** frame)
+{
+	if(!framesInArena){
+		cvReleaseData(*frame);
+	}
+	cvReleaseImageHeader(frame);
+}
+
+void decodeAhead::setFrameRange(UINT64 firstFrame, UINT64 endFrame)
+{
+	this->firstFrame = firstFrame;
+	this->endFrame = endFrame;
+}
+
+void decodeAhead::setMask(const arenaMask * mask)
+{
+	this->mask = mask;
+}
+
+bool decodeAhead::start()
+{
+	if(emptySlots == NULL || fullSlots == NULL){
+		fprintf(stderr,"Error creating decode-ahead semaphores\n");
+		return false;
+	}
+	// the spans of the mask are only valid for frames cropped the same way.
+	// a mask shrinks the ROI to its bounds, whose width is arbitrary, which
+	// the packed ring frames take as it is
+	if(mask != NULL){
+		CvRect maskROI = mask->getROI();
+		if(maskROI.x != roi.x || maskROI.y != roi.y || maskROI.width != roi.width || maskROI.height != roi.height){
+			fprintf(stderr,"Arena mask is cropped to %d,%d,%d,%d, the frames to %d,%d,%d,%d\n",
+				maskROI.x,maskROI.y,maskROI.width,maskROI.height,roi.x,roi.y,roi.width,roi.height);
+			return false;
+		}
+	}
+	thread = CreateThread(NULL,0,decodeThread,this,0,NULL);
+	if(thread == NULL){
+		fprintf(stderr,"Error starting decode-ahead thread\n");
+		return false;
+	}
+	return true;
+}
+
+bool decodeAhead::stop()
+{
+	if(thread == NULL){
+		return true;
+	}
+
+	// wake the decoder in case it is waiting for a free slot
+	InterlockedExchange(&stopRequested,1);
+	ReleaseSemaphore(emptySlots,1,NULL);
+
+	bool success = WaitForSingleObject(thread,INFINITE) == WAIT_OBJECT_0;
+	CloseHandle(thread);
+	thread = NULL;
+	return success;
+}
+
+IplImage * decodeAhead::getFrame(UINT64 &frameNumber)
+{
+	// poll first, so that waiting for the decoder is counted
+	DWORD result = WaitForSingleObject(fullSlots,0);
+	if(result == WAIT_TIMEOUT){
+		writerWaits++;
+		result = WaitForSingleObject(fullSlots,INFINITE);
+	}
+	if(result != WAIT_OBJECT_0){
+		fprintf(stderr,"Error waiting for decode-ahead thread\n");
+		readFailed = true;
+		return NULL;
+	}
+	frameNumber = ringFrameNumbers[readIndex];
+	if(ringEnd[readIndex]){
+		return NULL;
+	}
+	return ringFrames[readIndex];
+}
+
+bool decodeAhead::getTimestamp(double &timestamp)
+{
+	timestamp = ringTimestamps[readIndex];
+	return ringTimestamped[readIndex];
+}
+
+void decodeAhead::releaseFrame()
+{
+	readIndex = (readIndex + 1) % depth;
+	ReleaseSemaphore(emptySlots,1,NULL);
+}
+
+DWORD WINAPI decodeAhead::decodeThread(LPVOID param)
+{
+	((decodeAhead*) param)->decodeLoop();
+	return 0;
+}
+
+void decodeAhead::decodeLoop()
+{
+	IplImage * frame = NULL;
+	UINT64 frameNumber;
+
+	for(frameNumber = firstFrame; ; frameNumber++){
+
+		DWORD result = WaitForSingleObject(emptySlots,0);
+		if(result == WAIT_TIMEOUT){
+			decoderWaits++;
+			result = WaitForSingleObject(emptySlots,INFINITE);
+		}
+		if(result != WAIT_OBJECT_0){
+			fprintf(stderr,"Error waiting for a free decode-ahead slot\n");
+			readFailed = true;
+			break;
+		}
+		if(stopRequested){
+			return;
+		}
+		if(frameNumber >= endFrame){
+			break;
+		}
+
+		IplImage * gray = ring[writeIndex];
+
+		// sources that make gray themselves write it straight into the ring,
+		// unless only part of it is kept
+		if(source->decodesToGray()){
+			IplImage * decoded = cropped ? fullFrame : gray;
+			if(!source->nextFrameInto(decoded)){
+				readFailed = source->failed();
+				break;
+			}
+			if(preview != NULL && !preview->setFrame(decoded)){
+				break;
+			}
+			if(cropped){
+				for(int y = 0; y < roi.height; y++){
+					memcpy(gray->imageData + (size_t) y * gray->widthStep,
+						decoded->imageData + (size_t) (roi.y + y) * decoded->widthStep + roi.x,roi.width);
+				}
+			}
+		}
+		else{
+			frame = source->nextFrame();
+			if(!frame){
+				readFailed = source->failed();
+				break;
+			}
+			if(preview != NULL && !preview->setFrame(frame)){
+				break;
+			}
+
+			unsigned char * dst = (unsigned char*) gray->imageData;
+			// bottom-up frames are walked from their last stored row
+			const unsigned char * src = (const unsigned char*) frame->imageData;
+			int srcStep = frame->widthStep;
+			if(frame->origin == IPL_ORIGIN_BL){
+				src += (size_t) (frame->height - 1) * srcStep;
+				srcStep = -srcStep;
+			}
+			// for 8-bit frames, src is moved to the top left of the region of
+			// interest. the other cases crop with an image ROI, which counts rows
+			// in storage order
+			src += (ptrdiff_t) roi.y * srcStep + roi.x * frame->nChannels;
+			CvRect storedROI = roi;
+			if(frame->origin == IPL_ORIGIN_BL){
+				storedROI.y = frame->height - roi.y - roi.height;
+			}
+
+			if(frame->nChannels == 3 && frame->depth == IPL_DEPTH_8U){
+				// monochrome cameras are often saved as RGB. as long as every frame
+				// has equal channels, copy one of them instead of converting
+				if(grayInRGB && extractGrayFromRGB(src,srcStep,dst,gray->widthStep,roi.width,roi.height)){
+					if(frameNumber - firstFrame + 1 == DECODEGRAYPROBEFRAMES){
+						fprintf(stderr,"Video is gray stored as RGB, skipping color conversion\n");
+					}
+				}
+				else{
+					if(grayInRGB && frameNumber - firstFrame >= DECODEGRAYPROBEFRAMES){
+						fprintf(stderr,"Frame %lu is not gray, converting color from now on\n",(unsigned long) frameNumber);
+					}
+					grayInRGB = false;
+					convertRGBToGray(src,srcStep,dst,gray->widthStep,roi.width,roi.height);
+				}
+			}
+			else if(frame->nChannels > 1){
+				cvSetImageROI(frame,storedROI);
+				cvCvtColor(frame,gray,CV_RGB2GRAY);
+				cvResetImageROI(frame);
+			}
+			else if(frame->depth == IPL_DEPTH_8U && srcStep == frame->width && roi.width == frame->width && source->framesPersist() && mask == NULL){
+				// the frame stays valid while it waits in the ring and is laid out
+				// the way ufmfWriter expects. cropping rows keeps it that way. a
+				// masked frame is copied, since the source frame is read-only
+				ringHeaders[writeIndex] = *frame;
+				gray = &ringHeaders[writeIndex];
+				gray->height = roi.height;
+				gray->imageSize = roi.height * frame->width;
+				gray->imageData = (char*) src;
+				gray->imageDataOrigin = gray->imageData;
+			}
+			else if(frame->depth == IPL_DEPTH_8U){
+				for(int y = 0; y < roi.height; y++){
+					memcpy(dst + (size_t) y * gray->widthStep,src + (ptrdiff_t) y * srcStep,roi.width);
+				}
+			}
+			else{
+				cvSetImageROI(frame,storedROI);
+				cvCopy(frame,gray);
+				cvResetImageROI(frame);
+			}
+		}
+		if(mask != NULL){
+			mask->fill(gray,DECODEMASKFILL);
+		}
+		ringFrames[writeIndex] = gray;
+		ringFrameNumbers[writeIndex] = frameNumber;
+		ringTimestamped[writeIndex] = source->getTimestamp(ringTimestamps[writeIndex]);
+		ringEnd[writeIndex] = false;
+		writeIndex = (writeIndex + 1) % depth;
+		ReleaseSemaphore(fullSlots,1,NULL);
+	}
+
+	// the slot we hold marks the end of the video for the writer. releasing it
+	// also publishes readFailed
+	ringFrameNumbers[writeIndex] = frameNumber;
+	ringEnd[writeIndex] = true;
+	ReleaseSemaphore(fullSlots,1,NULL);
+}
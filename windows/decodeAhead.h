@@ -0,0 +1,109 @@
+#pragma once
+
+#include "winCompat.h"
+
+#include "cv.h"
+#include "frameSource.h"
+#include "previewWindow.h"
+#include "arenaMask.h"
+#include "frameArena.h"
+
+// default number of decoded frames buffered ahead of the writer
+#define DECODEAHEADDEPTH 8
+// number of RGB frames with equal channels after which the video is reported
+// as gray stored as RGB. every later frame is still checked
+#define DECODEGRAYPROBEFRAMES 10
+// value of the pixels outside the arena mask
+#define DECODEMASKFILL 0
+
+// decodeAhead reads frames from the input video on its own thread, converts
+// them to 8-bit gray and queues them in a bounded ring of pre-allocated frames,
+// so that decoding overlaps with compression in ufmfWriter. The ring lives in
+// one frameArena, so no memory is allocated per frame. Gray frames from a
+// source whose frames persist are queued as they are, without a copy. Only
+// the region of interest of each frame is converted and queued
+class decodeAhead {
+
+public:
+
+	// roi is the part of the source frames that is kept, and the size of the
+	// frames getFrame returns. preview may be NULL in headless mode
+	decodeAhead(frameSource * source, CvRect roi, int depth, previewWindow * preview);
+	~decodeAhead();
+
+	// number frames from firstFrame and stop before endFrame. must be called
+	// before start. the source must already be at firstFrame
+	void setFrameRange(UINT64 firstFrame, UINT64 endFrame);
+	// pixels outside the arena are set to DECODEMASKFILL. must be called
+	// before start, with the mask set to the same ROI as the decoder, or start
+	// fails
+	void setMask(const arenaMask * mask);
+
+	bool start();
+	bool stop();
+
+	// blocks until the next gray frame is available. returns NULL once the
+	// video is finished or the preview was closed
+	IplImage * getFrame(UINT64 &frameNumber);
+	// the timestamp the source gave the frame from the last getFrame call.
+	// false if the source has none
+	bool getTimestamp(double &timestamp);
+	// returns the frame from the last getFrame call to the ring
+	void releaseFrame();
+	// true once getFrame has returned NULL because the video could not be
+	// read, rather than because it ended or the preview was closed
+	bool failed() { return readFailed; }
+
+	// queue pressure: how often the decoder found the ring full and had to
+	// wait for the writer, and how often getFrame found it empty and had to
+	// wait for the decoder. final once getFrame has returned NULL
+	UINT64 getDecoderWaits() { return decoderWaits; }
+	UINT64 getWriterWaits() { return writerWaits; }
+
+private:
+
+	static DWORD WINAPI decodeThread(LPVOID param);
+	void decodeLoop();
+	void setFrameData(IplImage * frame);
+	void releaseFrameData(IplImage ** frame);
+
+	frameSource * source;
+	previewWindow * preview;
+	CvRect roi;
+	bool cropped;
+	// full frames of sources that decode to gray themselves, when cropping
+	IplImage * fullFrame;
+	const arenaMask * mask;
+
+	UINT64 firstFrame;
+	UINT64 endFrame;
+
+	int depth;
+	// holds the pixels of the ring frames and fullFrame
+	frameArena arena;
+	bool framesInArena;
+	IplImage ** ring;
+	// frame handed out for each slot: the ring frame, or the header in
+	// ringHeaders of a source frame queued without a copy
+	IplImage ** ringFrames;
+	IplImage * ringHeaders;
+	UINT64 * ringFrameNumbers;
+	double * ringTimestamps;
+	bool * ringTimestamped;
+	bool * ringEnd;
+	// set by the decoder before it queues the end marker
+	bool readFailed;
+	int readIndex;
+	int writeIndex;
+
+	HANDLE emptySlots;
+	HANDLE fullSlots;
+	HANDLE thread;
+	volatile LONG stopRequested;
+
+	UINT64 decoderWaits;
+	UINT64 writerWaits;
+
+	// true while every RGB frame so far had equal channels
+	bool grayInRGB;
+};
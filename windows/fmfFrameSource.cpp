@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "fmfFrameSource.h"
+
+// size of the timestamp at the start of every chunk
+#define FMFTIMESTAMPSIZE 8
+
+// FMF fields are little-endian and not necessarily aligned
+static UINT32 readU32(const unsigned char * p)
+{
+	UINT32 v;
+	memcpy(&v,p,4);
+	return v;
+}
+
+static UINT64 readU64(const unsigned char * p)
+{
+	UINT64 v;
+	memcpy(&v,p,8);
+	return v;
+}
+
+fmfFrameSource::fmfFrameSource()
+{
+	width = 0;
+	height = 0;
+	headerSize = 0;
+	chunkSize = 0;
+	frameCount = 0;
+	nextFrameIndex = 0;
+}
+
+fmfFrameSource::~fmfFrameSource()
+{
+	file.close();
+}
+
+bool fmfFrameSource::open(const char * fileName)
+{
+	if(!file.open(fileName)){
+		return false;
+	}
+	const unsigned char * data = file.getData();
+	UINT64 size = file.getSize();
+	if(size < 4){
+		return false;
+	}
+
+	// version 1 is always MONO8. version 3 names its pixel format
+	UINT32 version = readU32(data);
+	UINT64 pos = 4;
+	if(version == 3){
+		if(size < pos + 4) return false;
+		UINT32 formatLength = readU32(data+pos);
+		pos += 4;
+		if(size < pos + formatLength + 4) return false;
+		bool mono8 = formatLength == 5 && memcmp(data+pos,"MONO8",5) == 0;
+		pos += formatLength;
+		UINT32 bitsPerPixel = readU32(data+pos);
+		pos += 4;
+		if(!mono8 || bitsPerPixel != 8){
+			return false;
+		}
+	}
+	else if(version != 1){
+		return false;
+	}
+	if(size < pos + 4+4+8+8){
+		return false;
+	}
+	height = readU32(data+pos);
+	width = readU32(data+pos+4);
+	chunkSize = readU64(data+pos+8);
+	frameCount = readU64(data+pos+16);
+	headerSize = pos + 4+4+8+8;
+	if(width == 0 || height == 0 || chunkSize < FMFTIMESTAMPSIZE + (UINT64) width * height){
+		return false;
+	}
+
+	// the count is left at 0 when recording was cut short, and only whole
+	// chunks are read
+	UINT64 chunksInFile = (size - headerSize) / chunkSize;
+	if(frameCount == 0 || frameCount > chunksInFile){
+		frameCount = chunksInFile;
+	}
+	if(frameCount == 0){
+		return false;
+	}
+
+	cvInitImageHeader(&header,cvSize(width,height),IPL_DEPTH_8U,1,IPL_ORIGIN_TL,4);
+	header.widthStep = width;
+	header.imageSize = width * height;
+	nextFrameIndex = 0;
+	return true;
+}
+
+bool fmfFrameSource::seek(UINT64 frameNumber)
+{
+	if(frameNumber > frameCount){
+		return false;
+	}
+	nextFrameIndex = frameNumber;
+	return true;
+}
+
+IplImage * fmfFrameSource::nextFrame()
+{
+	if(nextFrameIndex >= frameCount){
+		return NULL;
+	}
+	const unsigned char * chunk = file.getData() + headerSize + nextFrameIndex++ * chunkSize;
+	header.imageData = (char*) chunk + FMFTIMESTAMPSIZE;
+	header.imageDataOrigin = header.imageData;
+	return &header;
+}
+
+bool fmfFrameSource::getTimestamp(double &timestamp)
+{
+	if(nextFrameIndex == 0){
+		return false;
+	}
+	memcpy(&timestamp,file.getData() + headerSize + (nextFrameIndex-1) * chunkSize,FMFTIMESTAMPSIZE);
+	return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "frameSource.h"
+#include "mappedFile.h"
+
+// fmfFrameSource reads uncompressed FMF (fly movie format) files, versions 1
+// and 3, straight out of a memory mapping of the file. Every frame is a
+// chunk of fixed size holding a timestamp and the pixels, so any frame is
+// found by its number alone and seeking is free. Frames are returned as
+// headers pointing into the mapping, with their stored timestamps. Only
+// MONO8 files are read; open fails for anything else
+class fmfFrameSource : public frameSource {
+
+public:
+
+	fmfFrameSource();
+	~fmfFrameSource();
+
+	bool open(const char * fileName);
+
+	UINT32 getWidth() { return width; }
+	UINT32 getHeight() { return height; }
+	UINT64 getFrameCount() { return frameCount; }
+	const char * getName() { return "native FMF"; }
+
+	bool seek(UINT64 frameNumber);
+	IplImage * nextFrame();
+	bool framesPersist() { return true; }
+	bool getTimestamp(double &timestamp);
+
+private:
+
+	mappedFile file;
+
+	UINT32 width;
+	UINT32 height;
+	// where the first chunk starts, and the size of each chunk
+	UINT64 headerSize;
+	UINT64 chunkSize;
+	UINT64 frameCount;
+
+	UINT64 nextFrameIndex;
+	IplImage header;
+};
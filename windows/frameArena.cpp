@@ -0,0 +1,93 @@
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "frameArena.h"
+
+frameArena::frameArena()
+{
+	data = NULL;
+	size = 0;
+	used = 0;
+	largePages = false;
+}
+
+frameArena::~frameArena()
+{
+	release();
+}
+
+size_t frameArena::blockSize(size_t size)
+{
+	return (size + FRAMEARENAALIGNMENT - 1) & ~(size_t) (FRAMEARENAALIGNMENT - 1);
+}
+
+bool frameArena::allocate(size_t size)
+{
+	release();
+	if(size == 0){
+		return false;
+	}
+
+#ifdef _WIN32
+	// large pages must be a whole number of large pages, and fail without
+	// the privilege, in which case normal pages are used
+	SIZE_T largePageSize = GetLargePageMinimum();
+	if(largePageSize > 0){
+		SIZE_T largeSize = (size + largePageSize - 1) & ~(largePageSize - 1);
+		data = (unsigned char*) VirtualAlloc(NULL,largeSize,MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,PAGE_READWRITE);
+		if(data != NULL){
+			largePages = true;
+			size = largeSize;
+		}
+	}
+	if(data == NULL){
+		data = (unsigned char*) VirtualAlloc(NULL,size,MEM_RESERVE | MEM_COMMIT,PAGE_READWRITE);
+	}
+#else
+	void * mapping = mmap(NULL,size,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+	if(mapping != MAP_FAILED){
+		data = (unsigned char*) mapping;
+#ifdef MADV_HUGEPAGE
+		largePages = madvise(mapping,size,MADV_HUGEPAGE) == 0;
+#endif
+	}
+#endif
+	if(data == NULL){
+		return false;
+	}
+	this->size = size;
+	used = 0;
+
+	// fault every page in now rather than on the first frames
+	memset(data,0,size);
+	return true;
+}
+
+void frameArena::release()
+{
+	if(data != NULL){
+#ifdef _WIN32
+		VirtualFree(data,0,MEM_RELEASE);
+#else
+		munmap(data,size);
+#endif
+	}
+	data = NULL;
+	size = 0;
+	used = 0;
+	largePages = false;
+}
+
+unsigned char * frameArena::take(size_t size)
+{
+	size = blockSize(size);
+	if(data == NULL || used + size > this->size){
+		return NULL;
+	}
+	unsigned char * block = data + used;
+	used += size;
+	return block;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "winCompat.h"
+
+// alignment of every block handed out by frameArena, enough for any SIMD load
+#define FRAMEARENAALIGNMENT 64
+
+// frameArena is one block of memory that all frames of a run are carved out
+// of, allocated up front and touched once so that no page faults or heap
+// calls happen while frames flow. Large pages are used where the OS allows
+// them (MEM_LARGE_PAGES, which needs the lock pages privilege, on Windows,
+// transparent huge pages on Linux), to cut TLB misses on big frames
+class frameArena {
+
+public:
+
+	frameArena();
+	~frameArena();
+
+	// reserves size bytes. blocks are taken from it with take
+	bool allocate(size_t size);
+	void release();
+
+	// next size bytes of the arena, aligned to FRAMEARENAALIGNMENT. NULL if
+	// the arena is full
+	unsigned char * take(size_t size);
+
+	// arena size needed for blocks of these sizes, with their alignment
+	static size_t blockSize(size_t size);
+
+	bool usesLargePages() { return largePages; }
+
+private:
+
+	unsigned char * data;
+	size_t size;
+	size_t used;
+	bool largePages;
+};
@@ -0,0 +1,53 @@
+#include "frameMailbox.h"
+
+#define MAILBOXINDEXMASK 3
+#define MAILBOXFRESH 4
+
+frameMailbox::frameMailbox()
+{
+	for(int i = 0; i < 3; i++){
+		buffers[i] = NULL;
+	}
+	backIndex = 0;
+	middle = 1;
+	frontIndex = 2;
+}
+
+frameMailbox::~frameMailbox()
+{
+	for(int i = 0; i < 3; i++){
+		if(buffers[i] != NULL){
+			cvReleaseImage(&buffers[i]);
+		}
+	}
+}
+
+void frameMailbox::put(const IplImage * frame)
+{
+	// buffers are allocated by the producer before anything is published, so
+	// the consumer never sees them half-initialized
+	if(buffers[0] == NULL){
+		for(int i = 0; i < 3; i++){
+			buffers[i] = cvCreateImage(cvGetSize(frame),frame->depth,frame->nChannels);
+			buffers[i]->origin = frame->origin;
+		}
+	}
+
+	// the preview runs far slower than the decoder, so most frames would be
+	// copied only to be overwritten
+	if((middle & MAILBOXFRESH) != 0){
+		return;
+	}
+
+	cvCopy(frame,buffers[backIndex]);
+	backIndex = InterlockedExchange(&middle,backIndex | MAILBOXFRESH) & MAILBOXINDEXMASK;
+}
+
+IplImage * frameMailbox::take()
+{
+	if((middle & MAILBOXFRESH) == 0){
+		return NULL;
+	}
+	frontIndex = InterlockedExchange(&middle,frontIndex) & MAILBOXINDEXMASK;
+	return buffers[frontIndex];
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "winCompat.h"
+
+#include "cv.h"
+
+// frameMailbox hands the most recent frame from one thread to another without
+// locking. It keeps three buffers: the producer fills the back buffer, the
+// consumer reads the front buffer, and each side swaps its buffer with the
+// middle one using a single interlocked exchange. Frames put while the last
+// one has not been taken are dropped before they are copied, so the producer
+// only copies as many frames as the consumer shows, and neither side ever
+// waits for the other
+class frameMailbox {
+
+public:
+
+	frameMailbox();
+	~frameMailbox();
+
+	// producer: copies frame into the back buffer and publishes it, unless
+	// the consumer has yet to take the frame published last
+	void put(const IplImage * frame);
+	// consumer: returns the newest frame if one was put since the last call,
+	// NULL otherwise. the frame stays valid until the next call to take
+	IplImage * take();
+
+private:
+
+	IplImage * buffers[3];
+	int backIndex;
+	int frontIndex;
+	// index of the middle buffer, or'ed with MAILBOXFRESH when it holds a
+	// frame the consumer has not taken yet
+	volatile LONG middle;
+};
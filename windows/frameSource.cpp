@@ -0,0 +1,38 @@
+#include "frameSource.h"
+#include "highguiFrameSource.h"
+#include "aviFrameSource.h"
+#include "fmfFrameSource.h"
+#include "imageSequenceFrameSource.h"
+
+frameSource * openFrameSource(const char * fileName, bool allowNative)
+{
+	// highgui cannot read a directory or a pattern, so these never reach it
+	if(imageSequenceFrameSource::isImageSequence(fileName)){
+		imageSequenceFrameSource * images = new imageSequenceFrameSource();
+		if(images->open(fileName)){
+			return images;
+		}
+		delete images;
+		return NULL;
+	}
+
+	if(allowNative){
+		aviFrameSource * avi = new aviFrameSource();
+		if(avi->open(fileName)){
+			return avi;
+		}
+		delete avi;
+		fmfFrameSource * fmf = new fmfFrameSource();
+		if(fmf->open(fileName)){
+			return fmf;
+		}
+		delete fmf;
+	}
+
+	highguiFrameSource * highgui = new highguiFrameSource();
+	if(highgui->open(fileName)){
+		return highgui;
+	}
+	delete highgui;
+	return NULL;
+}
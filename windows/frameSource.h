@@ -0,0 +1,56 @@
+#pragma once
+
+#include "winCompat.h"
+
+#include "cv.h"
+
+// frameSource is where decodeAhead gets its frames from: a highgui capture,
+// or one of the native readers for formats that can be read faster directly
+class frameSource {
+
+public:
+
+	virtual ~frameSource() {}
+
+	virtual bool open(const char * fileName) = 0;
+
+	virtual UINT32 getWidth() = 0;
+	virtual UINT32 getHeight() = 0;
+	// number of frames in the video, 0 if unknown
+	virtual UINT64 getFrameCount() = 0;
+	// name of the reader, for the log
+	virtual const char * getName() = 0;
+
+	// makes frameNumber the next frame nextFrame returns
+	virtual bool seek(UINT64 frameNumber) = 0;
+
+	// returns the next frame, or NULL at the end of the video. The frame
+	// belongs to the source; it may be 8-bit gray or BGR and may be stored
+	// bottom-up (origin IPL_ORIGIN_BL)
+	virtual IplImage * nextFrame() = 0;
+
+	// true if frames from nextFrame stay valid until the source is deleted,
+	// rather than until the next call, so they can be queued without a copy
+	virtual bool framesPersist() = 0;
+
+	// sources that produce gray themselves, by decoding it or through a
+	// palette, can write it straight into the frame that goes to the writer.
+	// nextFrameInto fills gray, which has the size of the video, and returns
+	// false at the end of the video
+	virtual bool decodesToGray() { return false; }
+	virtual bool nextFrameInto(IplImage * gray) { return false; }
+
+	// timestamp of the frame returned last, for sources whose frames carry
+	// one. false if frames are only numbered
+	virtual bool getTimestamp(double &timestamp) { return false; }
+
+	// true once nextFrame or nextFrameInto has returned no frame because the
+	// video could not be read, rather than because it ended
+	virtual bool failed() { return false; }
+};
+
+// opens fileName with the first reader that accepts it. a directory or a
+// pattern with * or ? is read as an image sequence. videos go to the native
+// AVI and FMF readers, which are only tried if allowNative is set; highgui is
+// the fallback for every video
+frameSource * openFrameSource(const char * fileName, bool allowNative);
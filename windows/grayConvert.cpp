@@ -0,0 +1,308 @@
+#include "grayConvert.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define GRAYCONVERT_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// VS2010 does not have the AVX2 intrinsics, which came with VS2012. without
+// them the SSE2 kernels are the fastest
+#if defined(GRAYCONVERT_X86) && (!defined(_MSC_VER) || _MSC_VER >= 1700)
+#define GRAYCONVERT_AVX2
+#endif
+
+// MSVC compiles any intrinsic anywhere; gcc needs the target on the function
+#if defined(GRAYCONVERT_X86) && defined(__GNUC__)
+#define GRAYCONVERT_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define GRAYCONVERT_TARGET_AVX2
+#endif
+
+// OpenCV's RGB to gray coefficients, scaled by 1 << GRAYSHIFT
+#define GRAYSHIFT 14
+#define GRAYR2Y 4899
+#define GRAYG2Y 9617
+#define GRAYB2Y 1868
+
+static void convertRowScalar(const unsigned char * src, unsigned char * dst, int width)
+{
+	for(int x = 0; x < width; x++, src += 3){
+		dst[x] = (unsigned char) ((src[0]*GRAYR2Y + src[1]*GRAYG2Y + src[2]*GRAYB2Y + (1 << (GRAYSHIFT-1))) >> GRAYSHIFT);
+	}
+}
+
+// returns nonzero if any pixel's channels differ
+static unsigned char extractRowScalar(const unsigned char * src, unsigned char * dst, int width)
+{
+	unsigned char diff = 0;
+	for(int x = 0; x < width; x++, src += 3){
+		dst[x] = src[0];
+		diff |= (src[0] ^ src[1]) | (src[0] ^ src[2]);
+	}
+	return diff;
+}
+
+#ifdef GRAYCONVERT_X86
+
+// Splits 32 interleaved 3-byte pixels, loaded as 6 consecutive registers
+// (c00 holds bytes 0-15, c01 bytes 16-31, ...), into their channels: on
+// return c00/c01 hold channel 0 of pixels 0-15/16-31, c10/c11 channel 1 and
+// c20/c21 channel 2. Each round of byte unpacks halves the interleave
+// distance; after five rounds the channels are contiguous. The same
+// sequence works within each 128-bit lane of AVX2 registers
+#define GRAYCONVERT_DEINTERLEAVE(T,UNPACKLO,UNPACKHI,c00,c01,c10,c11,c20,c21) \
+	{ \
+		T a0 = UNPACKLO(c00,c11), a1 = UNPACKHI(c00,c11); \
+		T a2 = UNPACKLO(c01,c20), a3 = UNPACKHI(c01,c20); \
+		T a4 = UNPACKLO(c10,c21), a5 = UNPACKHI(c10,c21); \
+		T b0 = UNPACKLO(a0,a3), b1 = UNPACKHI(a0,a3); \
+		T b2 = UNPACKLO(a1,a4), b3 = UNPACKHI(a1,a4); \
+		T b4 = UNPACKLO(a2,a5), b5 = UNPACKHI(a2,a5); \
+		a0 = UNPACKLO(b0,b3); a1 = UNPACKHI(b0,b3); \
+		a2 = UNPACKLO(b1,b4); a3 = UNPACKHI(b1,b4); \
+		a4 = UNPACKLO(b2,b5); a5 = UNPACKHI(b2,b5); \
+		b0 = UNPACKLO(a0,a3); b1 = UNPACKHI(a0,a3); \
+		b2 = UNPACKLO(a1,a4); b3 = UNPACKHI(a1,a4); \
+		b4 = UNPACKLO(a2,a5); b5 = UNPACKHI(a2,a5); \
+		c00 = UNPACKLO(b0,b3); c01 = UNPACKHI(b0,b3); \
+		c10 = UNPACKLO(b1,b4); c11 = UNPACKHI(b1,b4); \
+		c20 = UNPACKLO(b2,b5); c21 = UNPACKHI(b2,b5); \
+	}
+
+// weighted sum of 8 pixels whose channels are in the low or high halves of
+// 16-bit lanes: pairs (c0,c1) and (c2,1) are multiplied with (R2Y,G2Y) and
+// (B2Y,rounding) by pmaddwd, giving 32-bit sums
+static inline __m128i graySum8SSE2(__m128i c0, __m128i c1, __m128i c2, __m128i rg, __m128i bOne, __m128i one, bool high)
+{
+	__m128i p01 = high ? _mm_unpackhi_epi16(c0,c1) : _mm_unpacklo_epi16(c0,c1);
+	__m128i p2 = high ? _mm_unpackhi_epi16(c2,one) : _mm_unpacklo_epi16(c2,one);
+	return _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(p01,rg),_mm_madd_epi16(p2,bOne)),GRAYSHIFT);
+}
+
+static inline __m128i gray16SSE2(__m128i c0, __m128i c1, __m128i c2, __m128i rg, __m128i bOne, __m128i one)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i c0l = _mm_unpacklo_epi8(c0,zero), c0h = _mm_unpackhi_epi8(c0,zero);
+	__m128i c1l = _mm_unpacklo_epi8(c1,zero), c1h = _mm_unpackhi_epi8(c1,zero);
+	__m128i c2l = _mm_unpacklo_epi8(c2,zero), c2h = _mm_unpackhi_epi8(c2,zero);
+	__m128i lo = _mm_packs_epi32(graySum8SSE2(c0l,c1l,c2l,rg,bOne,one,false),graySum8SSE2(c0l,c1l,c2l,rg,bOne,one,true));
+	__m128i hi = _mm_packs_epi32(graySum8SSE2(c0h,c1h,c2h,rg,bOne,one,false),graySum8SSE2(c0h,c1h,c2h,rg,bOne,one,true));
+	return _mm_packus_epi16(lo,hi);
+}
+
+static void convertRowSSE2(const unsigned char * src, unsigned char * dst, int width)
+{
+	const __m128i rg = _mm_set1_epi32(GRAYR2Y | (GRAYG2Y << 16));
+	const __m128i bOne = _mm_set1_epi32(GRAYB2Y | ((1 << (GRAYSHIFT-1)) << 16));
+	const __m128i one = _mm_set1_epi16(1);
+
+	int x = 0;
+	for(; x + 32 <= width; x += 32, src += 96){
+		__m128i c00 = _mm_loadu_si128((const __m128i*) (src));
+		__m128i c01 = _mm_loadu_si128((const __m128i*) (src + 16));
+		__m128i c10 = _mm_loadu_si128((const __m128i*) (src + 32));
+		__m128i c11 = _mm_loadu_si128((const __m128i*) (src + 48));
+		__m128i c20 = _mm_loadu_si128((const __m128i*) (src + 64));
+		__m128i c21 = _mm_loadu_si128((const __m128i*) (src + 80));
+		GRAYCONVERT_DEINTERLEAVE(__m128i,_mm_unpacklo_epi8,_mm_unpackhi_epi8,c00,c01,c10,c11,c20,c21);
+		_mm_storeu_si128((__m128i*) (dst + x),gray16SSE2(c00,c10,c20,rg,bOne,one));
+		_mm_storeu_si128((__m128i*) (dst + x + 16),gray16SSE2(c01,c11,c21,rg,bOne,one));
+	}
+	convertRowScalar(src,dst + x,width - x);
+}
+
+static unsigned char extractRowSSE2(const unsigned char * src, unsigned char * dst, int width)
+{
+	__m128i diff = _mm_setzero_si128();
+
+	int x = 0;
+	for(; x + 32 <= width; x += 32, src += 96){
+		__m128i c00 = _mm_loadu_si128((const __m128i*) (src));
+		__m128i c01 = _mm_loadu_si128((const __m128i*) (src + 16));
+		__m128i c10 = _mm_loadu_si128((const __m128i*) (src + 32));
+		__m128i c11 = _mm_loadu_si128((const __m128i*) (src + 48));
+		__m128i c20 = _mm_loadu_si128((const __m128i*) (src + 64));
+		__m128i c21 = _mm_loadu_si128((const __m128i*) (src + 80));
+		GRAYCONVERT_DEINTERLEAVE(__m128i,_mm_unpacklo_epi8,_mm_unpackhi_epi8,c00,c01,c10,c11,c20,c21);
+		_mm_storeu_si128((__m128i*) (dst + x),c00);
+		_mm_storeu_si128((__m128i*) (dst + x + 16),c01);
+		diff = _mm_or_si128(diff,_mm_or_si128(_mm_xor_si128(c00,c10),_mm_xor_si128(c00,c20)));
+		diff = _mm_or_si128(diff,_mm_or_si128(_mm_xor_si128(c01,c11),_mm_xor_si128(c01,c21)));
+	}
+	bool same = _mm_movemask_epi8(_mm_cmpeq_epi8(diff,_mm_setzero_si128())) == 0xffff;
+	return (same ? 0 : 1) | extractRowScalar(src,dst + x,width - x);
+}
+
+#ifdef GRAYCONVERT_AVX2
+
+GRAYCONVERT_TARGET_AVX2
+static inline __m256i graySum8AVX2(__m256i p01, __m256i p2, __m256i rg, __m256i bOne)
+{
+	return _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(p01,rg),_mm256_madd_epi16(p2,bOne)),GRAYSHIFT);
+}
+
+GRAYCONVERT_TARGET_AVX2
+static inline __m256i gray16AVX2(__m256i c0, __m256i c1, __m256i c2, __m256i rg, __m256i bOne, __m256i one)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i c0l = _mm256_unpacklo_epi8(c0,zero), c0h = _mm256_unpackhi_epi8(c0,zero);
+	__m256i c1l = _mm256_unpacklo_epi8(c1,zero), c1h = _mm256_unpackhi_epi8(c1,zero);
+	__m256i c2l = _mm256_unpacklo_epi8(c2,zero), c2h = _mm256_unpackhi_epi8(c2,zero);
+	__m256i lo = _mm256_packs_epi32(graySum8AVX2(_mm256_unpacklo_epi16(c0l,c1l),_mm256_unpacklo_epi16(c2l,one),rg,bOne),
+		graySum8AVX2(_mm256_unpackhi_epi16(c0l,c1l),_mm256_unpackhi_epi16(c2l,one),rg,bOne));
+	__m256i hi = _mm256_packs_epi32(graySum8AVX2(_mm256_unpacklo_epi16(c0h,c1h),_mm256_unpacklo_epi16(c2h,one),rg,bOne),
+		graySum8AVX2(_mm256_unpackhi_epi16(c0h,c1h),_mm256_unpackhi_epi16(c2h,one),rg,bOne));
+	return _mm256_packus_epi16(lo,hi);
+}
+
+// loads 16 bytes from each of two addresses into the two lanes of a register
+GRAYCONVERT_TARGET_AVX2
+static inline __m256i loadLanesAVX2(const unsigned char * lo, const unsigned char * hi)
+{
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) lo)),_mm_loadu_si128((const __m128i*) hi),1);
+}
+
+// 64 pixels per iteration: the low lanes carry pixels 0-31 and the high lanes
+// pixels 32-63, so the in-lane SSE2 deinterleave applies unchanged
+GRAYCONVERT_TARGET_AVX2
+static void convertRowAVX2(const unsigned char * src, unsigned char * dst, int width)
+{
+	const __m256i rg = _mm256_set1_epi32(GRAYR2Y | (GRAYG2Y << 16));
+	const __m256i bOne = _mm256_set1_epi32(GRAYB2Y | ((1 << (GRAYSHIFT-1)) << 16));
+	const __m256i one = _mm256_set1_epi16(1);
+
+	int x = 0;
+	for(; x + 64 <= width; x += 64, src += 192){
+		__m256i c00 = loadLanesAVX2(src,src + 96);
+		__m256i c01 = loadLanesAVX2(src + 16,src + 112);
+		__m256i c10 = loadLanesAVX2(src + 32,src + 128);
+		__m256i c11 = loadLanesAVX2(src + 48,src + 144);
+		__m256i c20 = loadLanesAVX2(src + 64,src + 160);
+		__m256i c21 = loadLanesAVX2(src + 80,src + 176);
+		GRAYCONVERT_DEINTERLEAVE(__m256i,_mm256_unpacklo_epi8,_mm256_unpackhi_epi8,c00,c01,c10,c11,c20,c21);
+		__m256i g0 = gray16AVX2(c00,c10,c20,rg,bOne,one);
+		__m256i g1 = gray16AVX2(c01,c11,c21,rg,bOne,one);
+		_mm256_storeu_si256((__m256i*) (dst + x),_mm256_permute2x128_si256(g0,g1,0x20));
+		_mm256_storeu_si256((__m256i*) (dst + x + 32),_mm256_permute2x128_si256(g0,g1,0x31));
+	}
+	convertRowSSE2(src,dst + x,width - x);
+}
+
+GRAYCONVERT_TARGET_AVX2
+static unsigned char extractRowAVX2(const unsigned char * src, unsigned char * dst, int width)
+{
+	__m256i diff = _mm256_setzero_si256();
+
+	int x = 0;
+	for(; x + 64 <= width; x += 64, src += 192){
+		__m256i c00 = loadLanesAVX2(src,src + 96);
+		__m256i c01 = loadLanesAVX2(src + 16,src + 112);
+		__m256i c10 = loadLanesAVX2(src + 32,src + 128);
+		__m256i c11 = loadLanesAVX2(src + 48,src + 144);
+		__m256i c20 = loadLanesAVX2(src + 64,src + 160);
+		__m256i c21 = loadLanesAVX2(src + 80,src + 176);
+		GRAYCONVERT_DEINTERLEAVE(__m256i,_mm256_unpacklo_epi8,_mm256_unpackhi_epi8,c00,c01,c10,c11,c20,c21);
+		_mm256_storeu_si256((__m256i*) (dst + x),_mm256_permute2x128_si256(c00,c01,0x20));
+		_mm256_storeu_si256((__m256i*) (dst + x + 32),_mm256_permute2x128_si256(c00,c01,0x31));
+		diff = _mm256_or_si256(diff,_mm256_or_si256(_mm256_xor_si256(c00,c10),_mm256_xor_si256(c00,c20)));
+		diff = _mm256_or_si256(diff,_mm256_or_si256(_mm256_xor_si256(c01,c11),_mm256_xor_si256(c01,c21)));
+	}
+	bool same = _mm256_testz_si256(diff,diff) != 0;
+	return (same ? 0 : 1) | extractRowSSE2(src,dst + x,width - x);
+}
+
+#endif
+
+static GrayConvertKernel detectKernel()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info,0);
+	int nIds = info[0];
+	__cpuid(info,1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool avx2 = false;
+#ifdef GRAYCONVERT_AVX2
+	// AVX2 also needs the OS to save the ymm registers
+	if(nIds >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6){
+		__cpuidex(info,7,0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#endif
+#else
+	__builtin_cpu_init();
+	bool sse2 = __builtin_cpu_supports("sse2") != 0;
+	bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+	if(avx2) return GrayConvertAVX2;
+	if(sse2) return GrayConvertSSE2;
+	return GrayConvertScalar;
+}
+
+#else
+
+static GrayConvertKernel detectKernel()
+{
+	return GrayConvertScalar;
+}
+
+#endif
+
+GrayConvertKernel grayConvertKernel()
+{
+	static GrayConvertKernel kernel = detectKernel();
+	return kernel;
+}
+
+const char * grayConvertKernelName(GrayConvertKernel kernel)
+{
+	switch(kernel){
+	case GrayConvertAVX2: return "AVX2";
+	case GrayConvertSSE2: return "SSE2";
+	default: return "scalar";
+	}
+}
+
+void convertRGBToGray(const unsigned char * src, int srcStep, unsigned char * dst, int dstStep, int width, int height)
+{
+	void (*convertRow)(const unsigned char *, unsigned char *, int) = convertRowScalar;
+#ifdef GRAYCONVERT_X86
+	switch(grayConvertKernel()){
+#ifdef GRAYCONVERT_AVX2
+	case GrayConvertAVX2: convertRow = convertRowAVX2; break;
+#endif
+	case GrayConvertSSE2: convertRow = convertRowSSE2; break;
+	default: break;
+	}
+#endif
+	for(int y = 0; y < height; y++, src += srcStep, dst += dstStep){
+		convertRow(src,dst,width);
+	}
+}
+
+bool extractGrayFromRGB(const unsigned char * src, int srcStep, unsigned char * dst, int dstStep, int width, int height)
+{
+	unsigned char (*extractRow)(const unsigned char *, unsigned char *, int) = extractRowScalar;
+#ifdef GRAYCONVERT_X86
+	switch(grayConvertKernel()){
+#ifdef GRAYCONVERT_AVX2
+	case GrayConvertAVX2: extractRow = extractRowAVX2; break;
+#endif
+	case GrayConvertSSE2: extractRow = extractRowSSE2; break;
+	default: break;
+	}
+#endif
+	// stop at the first row that is not gray
+	for(int y = 0; y < height; y++, src += srcStep, dst += dstStep){
+		if(extractRow(src,dst,width) != 0){
+			return false;
+		}
+	}
+	return true;
+}
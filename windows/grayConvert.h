@@ -0,0 +1,26 @@
+#pragma once
+
+// grayConvert converts interleaved 3-channel 8-bit frames to 8-bit gray with
+// SSE2 or AVX2 kernels picked at run time. AVX2 is only built with gcc or
+// VS2012 and later. The result is bit-identical to cvCvtColor(src,dst,
+// CV_RGB2GRAY): channel 0 is weighted as red and channel 2 as blue, with
+// OpenCV's 14-bit fixed-point coefficients and rounding
+
+// which kernel convertRGBToGray uses on this machine
+typedef enum {
+	GrayConvertScalar,
+	GrayConvertSSE2,
+	GrayConvertAVX2
+} GrayConvertKernel;
+
+GrayConvertKernel grayConvertKernel();
+const char * grayConvertKernelName(GrayConvertKernel kernel);
+
+// src and dst are the first pixel of the first row, steps are in bytes
+void convertRGBToGray(const unsigned char * src, int srcStep, unsigned char * dst, int dstStep, int width, int height);
+
+// copies channel 0 into dst and returns true if all three channels are equal
+// in every pixel, as in monochrome video saved as RGB. The weights sum to
+// 1 << 14, so dst is then exactly what convertRGBToGray would produce. When
+// this returns false dst is incomplete and the frame must be converted
+bool extractGrayFromRGB(const unsigned char * src, int srcStep, unsigned char * dst, int dstStep, int width, int height);
@@ -0,0 +1,53 @@
+#include "highguiFrameSource.h"
+
+highguiFrameSource::highguiFrameSource()
+{
+	capture = NULL;
+	pendingFrame = NULL;
+	width = 0;
+	height = 0;
+	frameCount = 0;
+}
+
+highguiFrameSource::~highguiFrameSource()
+{
+	if(capture != NULL){
+		cvReleaseCapture(&capture);
+		capture = NULL;
+	}
+}
+
+bool highguiFrameSource::open(const char * fileName)
+{
+	capture = cvCaptureFromAVI(fileName);
+	if(capture == NULL){
+		return false;
+	}
+
+	pendingFrame = cvQueryFrame(capture); // this call is necessary to get correct capture properties
+	if(pendingFrame == NULL){
+		return false;
+	}
+	height = (UINT32) cvGetCaptureProperty(capture, CV_CAP_PROP_FRAME_HEIGHT);
+	width = (UINT32) cvGetCaptureProperty(capture, CV_CAP_PROP_FRAME_WIDTH);
+	double nFrames = cvGetCaptureProperty(capture, CV_CAP_PROP_FRAME_COUNT);
+	frameCount = nFrames > 0 ? (UINT64) nFrames : 0;
+	return true;
+}
+
+bool highguiFrameSource::seek(UINT64 frameNumber)
+{
+	pendingFrame = NULL;
+	cvSetCaptureProperty(capture,CV_CAP_PROP_POS_FRAMES,(double) frameNumber);
+	return (UINT64) cvGetCaptureProperty(capture,CV_CAP_PROP_POS_FRAMES) == frameNumber;
+}
+
+IplImage * highguiFrameSource::nextFrame()
+{
+	if(pendingFrame != NULL){
+		IplImage * frame = pendingFrame;
+		pendingFrame = NULL;
+		return frame;
+	}
+	return cvQueryFrame(capture);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "frameSource.h"
+#include "highgui.h"
+
+// frameSource on top of a highgui capture, for any video highgui can decode
+class highguiFrameSource : public frameSource {
+
+public:
+
+	highguiFrameSource();
+	~highguiFrameSource();
+
+	bool open(const char * fileName);
+
+	UINT32 getWidth() { return width; }
+	UINT32 getHeight() { return height; }
+	UINT64 getFrameCount() { return frameCount; }
+	const char * getName() { return "highgui"; }
+
+	bool seek(UINT64 frameNumber);
+	IplImage * nextFrame();
+	bool framesPersist() { return false; }
+
+private:
+
+	CvCapture * capture;
+	// frame read while opening to get the capture properties. it is
+	// returned by the first call to nextFrame
+	IplImage * pendingFrame;
+	UINT32 width;
+	UINT32 height;
+	UINT64 frameCount;
+};
@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <algorithm>
+
+#ifndef _WIN32
+#include <glob.h>
+#include <sys/stat.h>
+#endif
+
+#include "imageSequenceFrameSource.h"
+
+// image types cvLoadImage reads. only these are picked up from a directory
+static const char * imageExtensions[] = {
+	"bmp", "dib", "jpg", "jpeg", "jpe", "jp2", "png", "pbm", "pgm", "ppm", "pnm",
+	"sr", "ras", "tif", "tiff"
+};
+
+static bool hasImageExtension(const std::string &fileName)
+{
+	size_t dot = fileName.find_last_of('.');
+	if(dot == std::string::npos){
+		return false;
+	}
+	std::string extension = fileName.substr(dot+1);
+	for(size_t i = 0; i < extension.size(); i++){
+		extension[i] = (char) tolower((unsigned char) extension[i]);
+	}
+	for(size_t i = 0; i < ARRAYSIZE(imageExtensions); i++){
+		if(extension == imageExtensions[i]){
+			return true;
+		}
+	}
+	return false;
+}
+
+// orders runs of digits by their value, so that frame2 sorts before frame10
+static bool naturalLess(const std::string &a, const std::string &b)
+{
+	size_t i = 0, j = 0;
+	while(i < a.size() && j < b.size()){
+		if(isdigit((unsigned char) a[i]) && isdigit((unsigned char) b[j])){
+			size_t startA = i, startB = j;
+			while(startA < a.size() && a[startA] == '0') startA++;
+			while(startB < b.size() && b[startB] == '0') startB++;
+			size_t endA = startA, endB = startB;
+			while(endA < a.size() && isdigit((unsigned char) a[endA])) endA++;
+			while(endB < b.size() && isdigit((unsigned char) b[endB])) endB++;
+			if(endA - startA != endB - startB){
+				return endA - startA < endB - startB;
+			}
+			int order = a.compare(startA,endA-startA,b,startB,endB-startB);
+			if(order != 0){
+				return order < 0;
+			}
+			i = endA;
+			j = endB;
+		}
+		else{
+			if(a[i] != b[j]){
+				return (unsigned char) a[i] < (unsigned char) b[j];
+			}
+			i++;
+			j++;
+		}
+	}
+	return a.size() - i < b.size() - j;
+}
+
+static bool isDirectory(const char * fileName)
+{
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributesA(fileName);
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+	struct stat info;
+	return stat(fileName,&info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+static int numberOfCPUs()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int) info.dwNumberOfProcessors;
+}
+
+bool imageSequenceFrameSource::isImageSequence(const char * fileName)
+{
+	return strchr(fileName,'*') != NULL || strchr(fileName,'?') != NULL || isDirectory(fileName);
+}
+
+imageSequenceFrameSource::imageSequenceFrameSource()
+{
+	width = 0;
+	height = 0;
+	nextFrameIndex = 0;
+	currentFrame = NULL;
+	readError = false;
+	nWorkers = 0;
+	nSlots = 0;
+	workers = NULL;
+	slots = NULL;
+	slotReady = NULL;
+	freeSlots = NULL;
+	nextClaim = 0;
+	stopRequested = 0;
+	running = false;
+}
+
+imageSequenceFrameSource::~imageSequenceFrameSource()
+{
+	stopWorkers();
+	if(workers != NULL){
+		delete [] workers;
+		workers = NULL;
+	}
+	if(slots != NULL){
+		delete [] slots;
+		slots = NULL;
+	}
+	if(slotReady != NULL){
+		delete [] slotReady;
+		slotReady = NULL;
+	}
+}
+
+bool imageSequenceFrameSource::listFiles(const char * fileName)
+{
+	std::string pattern = fileName;
+	bool wholeDirectory = isDirectory(fileName);
+	if(wholeDirectory){
+		if(pattern.empty() || (pattern[pattern.size()-1] != '/' && pattern[pattern.size()-1] != '\\')){
+			pattern += '/';
+		}
+		pattern += '*';
+	}
+
+#ifdef _WIN32
+	// FindFirstFile returns bare names, so the directory is put back in front
+	size_t slash = pattern.find_last_of("/\\");
+	std::string directory = slash == std::string::npos ? std::string() : pattern.substr(0,slash+1);
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA(pattern.c_str(),&data);
+	if(find != INVALID_HANDLE_VALUE){
+		do{
+			if((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0){
+				fileNames.push_back(directory + data.cFileName);
+			}
+		} while(FindNextFileA(find,&data));
+		FindClose(find);
+	}
+#else
+	// GLOB_MARK ends directory names with a slash, so they can be skipped
+	glob_t matches;
+	if(glob(pattern.c_str(),GLOB_MARK,NULL,&matches) == 0){
+		for(size_t i = 0; i < matches.gl_pathc; i++){
+			std::string match = matches.gl_pathv[i];
+			if(!match.empty() && match[match.size()-1] != '/'){
+				fileNames.push_back(match);
+			}
+		}
+	}
+	globfree(&matches);
+#endif
+
+	// a pattern says which files are images, a directory may hold other files
+	if(wholeDirectory){
+		size_t nImages = 0;
+		for(size_t i = 0; i < fileNames.size(); i++){
+			if(hasImageExtension(fileNames[i])){
+				fileNames[nImages++] = fileNames[i];
+			}
+		}
+		fileNames.resize(nImages);
+	}
+	std::sort(fileNames.begin(),fileNames.end(),naturalLess);
+	return !fileNames.empty();
+}
+
+bool imageSequenceFrameSource::open(const char * fileName)
+{
+	if(!isImageSequence(fileName) || !listFiles(fileName)){
+		return false;
+	}
+
+	IplImage * first = cvLoadImage(fileNames[0].c_str(),CV_LOAD_IMAGE_GRAYSCALE);
+	if(first == NULL){
+		fprintf(stderr,"Error reading image %s\n",fileNames[0].c_str());
+		return false;
+	}
+	width = first->width;
+	height = first->height;
+	cvReleaseImage(&first);
+
+	nWorkers = numberOfCPUs();
+	if(nWorkers < 1) nWorkers = 1;
+	nSlots = nWorkers * IMAGESEQUENCESLOTSPERWORKER;
+	workers = new HANDLE[nWorkers];
+	slots = new IplImage*[nSlots];
+	slotReady = new HANDLE[nSlots];
+	for(int i = 0; i < nWorkers; i++){
+		workers[i] = NULL;
+	}
+	for(int i = 0; i < nSlots; i++){
+		slots[i] = NULL;
+		slotReady[i] = NULL;
+	}
+	nextFrameIndex = 0;
+	return true;
+}
+
+bool imageSequenceFrameSource::startWorkers()
+{
+	// room for a wake-up per worker on top of the slots, for stopWorkers
+	freeSlots = CreateSemaphore(NULL,nSlots,nSlots+nWorkers,NULL);
+	for(int i = 0; i < nSlots; i++){
+		slotReady[i] = CreateSemaphore(NULL,0,1,NULL);
+	}
+	nextClaim = (LONG) nextFrameIndex;
+	stopRequested = 0;
+	running = true;
+
+	for(int i = 0; i < nWorkers; i++){
+		workers[i] = CreateThread(NULL,0,workerThread,this,0,NULL);
+		if(workers[i] == NULL){
+			fprintf(stderr,"Error starting image decoding thread\n");
+			stopWorkers();
+			return false;
+		}
+	}
+	return true;
+}
+
+void imageSequenceFrameSource::stopWorkers()
+{
+	if(currentFrame != NULL){
+		cvReleaseImage(&currentFrame);
+	}
+	if(!running){
+		return;
+	}
+
+	// wake the workers waiting for a slot
+	InterlockedExchange(&stopRequested,1);
+	ReleaseSemaphore(freeSlots,nWorkers,NULL);
+	for(int i = 0; i < nWorkers && workers[i] != NULL; i++){
+		WaitForSingleObject(workers[i],INFINITE);
+		CloseHandle(workers[i]);
+		workers[i] = NULL;
+	}
+
+	// frames decoded ahead of the reader are dropped
+	for(int i = 0; i < nSlots; i++){
+		if(slots[i] != NULL){
+			cvReleaseImage(&slots[i]);
+		}
+		CloseHandle(slotReady[i]);
+		slotReady[i] = NULL;
+	}
+	CloseHandle(freeSlots);
+	freeSlots = NULL;
+	running = false;
+}
+
+DWORD WINAPI imageSequenceFrameSource::workerThread(LPVOID param)
+{
+	((imageSequenceFrameSource*) param)->decodeLoop();
+	return 0;
+}
+
+void imageSequenceFrameSource::decodeLoop()
+{
+	for(;;){
+		// frames are claimed in order, and only once their slot has been
+		// emptied by the reader
+		if(WaitForSingleObject(freeSlots,INFINITE) != WAIT_OBJECT_0 || stopRequested){
+			return;
+		}
+		LONG frameNumber = InterlockedIncrement(&nextClaim) - 1;
+		if(frameNumber >= (LONG) fileNames.size()){
+			return;
+		}
+
+		// a frame that cannot be read or has the wrong size is left NULL,
+		// which ends the video with an error
+		IplImage * image = cvLoadImage(fileNames[frameNumber].c_str(),CV_LOAD_IMAGE_GRAYSCALE);
+		if(image != NULL && ((UINT32) image->width != width || (UINT32) image->height != height)){
+			cvReleaseImage(&image);
+		}
+		int slot = frameNumber % nSlots;
+		slots[slot] = image;
+		ReleaseSemaphore(slotReady[slot],1,NULL);
+	}
+}
+
+bool imageSequenceFrameSource::seek(UINT64 frameNumber)
+{
+	// the workers restart from the new frame on the next call to nextFrame
+	stopWorkers();
+	if(frameNumber >= fileNames.size()){
+		return false;
+	}
+	nextFrameIndex = frameNumber;
+	return true;
+}
+
+IplImage * imageSequenceFrameSource::nextFrame()
+{
+	// the frame returned last is no longer needed, so its slot can be reused
+	if(currentFrame != NULL){
+		cvReleaseImage(&currentFrame);
+		ReleaseSemaphore(freeSlots,1,NULL);
+	}
+	if(nextFrameIndex >= fileNames.size()){
+		return NULL;
+	}
+	if(!running && !startWorkers()){
+		readError = true;
+		return NULL;
+	}
+
+	int slot = (int) (nextFrameIndex % nSlots);
+	if(WaitForSingleObject(slotReady[slot],INFINITE) != WAIT_OBJECT_0){
+		fprintf(stderr,"Error waiting for image decoding thread\n");
+		readError = true;
+		return NULL;
+	}
+	currentFrame = slots[slot];
+	slots[slot] = NULL;
+	if(currentFrame == NULL){
+		fprintf(stderr,"Error reading image %s, or its size is not %ux%u\n",fileNames[nextFrameIndex].c_str(),width,height);
+		nextFrameIndex = fileNames.size();
+		readError = true;
+		return NULL;
+	}
+	nextFrameIndex++;
+	return currentFrame;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "frameSource.h"
+#include "highgui.h"
+
+// decoded frames kept per worker, between the workers and nextFrame
+#define IMAGESEQUENCESLOTSPERWORKER 2
+
+// imageSequenceFrameSource reads a directory of images, or the images
+// matching a wildcard pattern, as a video whose frames are the files in
+// natural order (frame2 before frame10). Every image is decoded on its own,
+// so a pool of worker threads, one per CPU, decodes them in parallel into a
+// fixed number of reorder slots, which nextFrame empties in frame order. Each
+// image is allocated by cvLoadImage and freed once the next frame is asked
+// for. Images are loaded as 8-bit gray and must all have the size of the
+// first one
+class imageSequenceFrameSource : public frameSource {
+
+public:
+
+	imageSequenceFrameSource();
+	~imageSequenceFrameSource();
+
+	// fileName is a directory, in which every image file is used, or a
+	// pattern with * or ?
+	bool open(const char * fileName);
+
+	UINT32 getWidth() { return width; }
+	UINT32 getHeight() { return height; }
+	UINT64 getFrameCount() { return fileNames.size(); }
+	const char * getName() { return "image sequence"; }
+
+	bool seek(UINT64 frameNumber);
+	IplImage * nextFrame();
+	bool framesPersist() { return false; }
+	bool failed() { return readError; }
+
+	// true if fileName names something this reader could open, so that the
+	// caller does not offer it to the video readers
+	static bool isImageSequence(const char * fileName);
+
+private:
+
+	bool listFiles(const char * fileName);
+	bool startWorkers();
+	void stopWorkers();
+	static DWORD WINAPI workerThread(LPVOID param);
+	void decodeLoop();
+
+	std::vector<std::string> fileNames;
+	UINT32 width;
+	UINT32 height;
+
+	// frame nextFrame returns next, and the frame it returned last, which
+	// holds a slot until the following call
+	UINT64 nextFrameIndex;
+	IplImage * currentFrame;
+	bool readError;
+
+	// frame f is decoded into slot f % nSlots. freeSlots counts slots that
+	// workers may claim a frame for, slotReady says a slot has been filled
+	int nWorkers;
+	int nSlots;
+	HANDLE * workers;
+	IplImage ** slots;
+	HANDLE * slotReady;
+	HANDLE freeSlots;
+	volatile LONG nextClaim;
+	volatile LONG stopRequested;
+	bool running;
+};
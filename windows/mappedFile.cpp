@@ -0,0 +1,121 @@
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mappedFile.h"
+
+// a 32-bit process cannot map more than this in one view
+#define MAPPEDFILEMAXSIZE32 ((UINT64) 1 << 30)
+
+mappedFile::mappedFile()
+{
+	data = NULL;
+	size = 0;
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = NULL;
+#else
+	fd = -1;
+#endif
+}
+
+mappedFile::~mappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool mappedFile::open(const char * fileName)
+{
+	close();
+
+	fileHandle = CreateFile(fileName,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+	if(fileHandle == INVALID_HANDLE_VALUE){
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(fileHandle,&fileSize) || fileSize.QuadPart == 0 ||
+		(sizeof(void*) < 8 && (UINT64) fileSize.QuadPart > MAPPEDFILEMAXSIZE32)){
+		close();
+		return false;
+	}
+	size = (UINT64) fileSize.QuadPart;
+
+	mappingHandle = CreateFileMapping(fileHandle,NULL,PAGE_READONLY,0,0,NULL);
+	if(mappingHandle == NULL){
+		close();
+		return false;
+	}
+	data = (const unsigned char*) MapViewOfFile(mappingHandle,FILE_MAP_READ,0,0,0);
+	if(data == NULL){
+		close();
+		return false;
+	}
+	return true;
+}
+
+void mappedFile::close()
+{
+	if(data != NULL){
+		UnmapViewOfFile(data);
+		data = NULL;
+	}
+	if(mappingHandle != NULL){
+		CloseHandle(mappingHandle);
+		mappingHandle = NULL;
+	}
+	if(fileHandle != INVALID_HANDLE_VALUE){
+		CloseHandle(fileHandle);
+		fileHandle = INVALID_HANDLE_VALUE;
+	}
+	size = 0;
+}
+
+#else
+
+bool mappedFile::open(const char * fileName)
+{
+	close();
+
+	fd = ::open(fileName,O_RDONLY);
+	if(fd < 0){
+		return false;
+	}
+	struct stat st;
+	if(fstat(fd,&st) != 0 || st.st_size == 0 ||
+		(sizeof(void*) < 8 && (UINT64) st.st_size > MAPPEDFILEMAXSIZE32)){
+		close();
+		return false;
+	}
+	size = (UINT64) st.st_size;
+
+	void * p = mmap(NULL,(size_t) size,PROT_READ,MAP_SHARED,fd,0);
+	if(p == MAP_FAILED){
+		close();
+		return false;
+	}
+	madvise(p,(size_t) size,MADV_SEQUENTIAL);
+	data = (const unsigned char*) p;
+	return true;
+}
+
+void mappedFile::close()
+{
+	if(data != NULL){
+		munmap((void*) data,(size_t) size);
+		data = NULL;
+	}
+	if(fd >= 0){
+		::close(fd);
+		fd = -1;
+	}
+	size = 0;
+}
+
+#endif
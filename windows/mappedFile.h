@@ -0,0 +1,31 @@
+#pragma once
+
+#include "winCompat.h"
+
+// mappedFile maps a whole file read-only into memory, so that frames can be
+// read straight out of the page cache without copying. The OS is told that
+// the file will be read sequentially so it reads ahead aggressively
+class mappedFile {
+
+public:
+
+	mappedFile();
+	~mappedFile();
+
+	bool open(const char * fileName);
+	void close();
+
+	const unsigned char * getData() { return data; }
+	UINT64 getSize() { return size; }
+
+private:
+
+	const unsigned char * data;
+	UINT64 size;
+#ifdef _WIN32
+	HANDLE fileHandle;
+	HANDLE mappingHandle;
+#else
+	int fd;
+#endif
+};
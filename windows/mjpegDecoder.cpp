@@ -0,0 +1,948 @@
+#include <string.h>
+
+#include "mjpegDecoder.h"
+#include "grayConvert.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define MJPEG_X86
+#include <emmintrin.h>
+#endif
+
+// markers
+#define JPEG_SOF0 0xC0
+#define JPEG_SOF1 0xC1
+#define JPEG_DHT 0xC4
+#define JPEG_RST0 0xD0
+#define JPEG_RST7 0xD7
+#define JPEG_SOI 0xD8
+#define JPEG_EOI 0xD9
+#define JPEG_SOS 0xDA
+#define JPEG_DQT 0xDB
+#define JPEG_DRI 0xDD
+
+// position in the block of the k-th coefficient in zigzag order. the extra
+// entries catch runs past the end in corrupt data
+static const unsigned char zigzag[64+16] = {
+	 0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+	63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63
+};
+
+// the Huffman tables of JPEG Annex K.3, used by MJPEG frames without a DHT
+static const unsigned char dcLumaCounts[16] = {0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0};
+static const unsigned char dcChromaCounts[16] = {0,3,1,1,1,1,1,1,1,1,1,0,0,0,0,0};
+static const unsigned char dcValues[12] = {0,1,2,3,4,5,6,7,8,9,10,11};
+static const unsigned char acLumaCounts[16] = {0,2,1,3,3,2,4,3,5,5,4,4,0,0,1,0x7d};
+static const unsigned char acLumaValues[162] = {
+	0x01,0x02,0x03,0x00,0x04,0x11,0x05,0x12,0x21,0x31,0x41,0x06,0x13,0x51,0x61,0x07,
+	0x22,0x71,0x14,0x32,0x81,0x91,0xa1,0x08,0x23,0x42,0xb1,0xc1,0x15,0x52,0xd1,0xf0,
+	0x24,0x33,0x62,0x72,0x82,0x09,0x0a,0x16,0x17,0x18,0x19,0x1a,0x25,0x26,0x27,0x28,
+	0x29,0x2a,0x34,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,
+	0x4a,0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,
+	0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x83,0x84,0x85,0x86,0x87,0x88,0x89,
+	0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,
+	0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,
+	0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,0xe1,0xe2,
+	0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf1,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,
+	0xf9,0xfa
+};
+static const unsigned char acChromaCounts[16] = {0,2,1,2,4,4,3,4,7,5,4,4,0,1,2,0x77};
+static const unsigned char acChromaValues[162] = {
+	0x00,0x01,0x02,0x03,0x11,0x04,0x05,0x21,0x31,0x06,0x12,0x41,0x51,0x07,0x61,0x71,
+	0x13,0x22,0x32,0x81,0x08,0x14,0x42,0x91,0xa1,0xb1,0xc1,0x09,0x23,0x33,0x52,0xf0,
+	0x15,0x62,0x72,0xd1,0x0a,0x16,0x24,0x34,0xe1,0x25,0xf1,0x17,0x18,0x19,0x1a,0x26,
+	0x27,0x28,0x29,0x2a,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,
+	0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5a,0x63,0x64,0x65,0x66,0x67,0x68,
+	0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x82,0x83,0x84,0x85,0x86,0x87,
+	0x88,0x89,0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,
+	0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,
+	0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,
+	0xe2,0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,
+	0xf9,0xfa
+};
+
+// fixed-point constants of the IJG islow IDCT, jidctint.c
+#define IDCT_CONST_BITS 13
+#define IDCT_PASS1_BITS 2
+#define FIX_0_298631336 2446
+#define FIX_0_390180644 3196
+#define FIX_0_541196100 4433
+#define FIX_0_765366865 6270
+#define FIX_0_899976223 7373
+#define FIX_1_175875602 9633
+#define FIX_1_501321110 12299
+#define FIX_1_847759065 15137
+#define FIX_1_961570560 16069
+#define FIX_2_053119869 16819
+#define FIX_2_562915447 20995
+#define FIX_3_072711026 25172
+#define DESCALE(x,n) (((x) + (1 << ((n)-1))) >> (n))
+
+static inline unsigned char clampSample(int x)
+{
+	x += 128;
+	return (unsigned char) (x < 0 ? 0 : x > 255 ? 255 : x);
+}
+
+// inverse DCT of dequantized coefficients in natural order
+static void inverseDCT(const int * in, unsigned char * out, int outStep)
+{
+	int workspace[64];
+
+	// columns
+	for(int c = 0; c < 8; c++){
+		const int * col = in + c;
+		int * ws = workspace + c;
+		if(col[8] == 0 && col[16] == 0 && col[24] == 0 && col[32] == 0 &&
+			col[40] == 0 && col[48] == 0 && col[56] == 0){
+			int dc = col[0] * (1 << IDCT_PASS1_BITS);
+			for(int r = 0; r < 8; r++) ws[8*r] = dc;
+			continue;
+		}
+
+		int z2 = col[16], z3 = col[48];
+		int z1 = (z2 + z3) * FIX_0_541196100;
+		int tmp2 = z1 - z3 * FIX_1_847759065;
+		int tmp3 = z1 + z2 * FIX_0_765366865;
+		int tmp0 = (col[0] + col[32]) * (1 << IDCT_CONST_BITS);
+		int tmp1 = (col[0] - col[32]) * (1 << IDCT_CONST_BITS);
+		int tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+		int tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+
+		tmp0 = col[56]; tmp1 = col[40]; tmp2 = col[24]; tmp3 = col[8];
+		z1 = tmp0 + tmp3; z2 = tmp1 + tmp2;
+		z3 = tmp0 + tmp2; int z4 = tmp1 + tmp3;
+		int z5 = (z3 + z4) * FIX_1_175875602;
+		tmp0 *= FIX_0_298631336; tmp1 *= FIX_2_053119869;
+		tmp2 *= FIX_3_072711026; tmp3 *= FIX_1_501321110;
+		z1 *= -FIX_0_899976223; z2 *= -FIX_2_562915447;
+		z3 *= -FIX_1_961570560; z4 *= -FIX_0_390180644;
+		z3 += z5; z4 += z5;
+		tmp0 += z1 + z3; tmp1 += z2 + z4;
+		tmp2 += z2 + z3; tmp3 += z1 + z4;
+
+		ws[0] = DESCALE(tmp10 + tmp3,IDCT_CONST_BITS-IDCT_PASS1_BITS);
+		ws[56] = DESCALE(tmp10 - tmp3,IDCT_CONST_BITS-IDCT_PASS1_BITS);
+		ws[8] = DESCALE(tmp11 + tmp2,IDCT_CONST_BITS-IDCT_PASS1_BITS);
+		ws[48] = DESCALE(tmp11 - tmp2,IDCT_CONST_BITS-IDCT_PASS1_BITS);
+		ws[16] = DESCALE(tmp12 + tmp1,IDCT_CONST_BITS-IDCT_PASS1_BITS);
+		ws[40] = DESCALE(tmp12 - tmp1,IDCT_CONST_BITS-IDCT_PASS1_BITS);
+		ws[24] = DESCALE(tmp13 + tmp0,IDCT_CONST_BITS-IDCT_PASS1_BITS);
+		ws[32] = DESCALE(tmp13 - tmp0,IDCT_CONST_BITS-IDCT_PASS1_BITS);
+	}
+
+	// rows
+	for(int r = 0; r < 8; r++, out += outStep){
+		const int * ws = workspace + 8*r;
+		if(ws[1] == 0 && ws[2] == 0 && ws[3] == 0 && ws[4] == 0 &&
+			ws[5] == 0 && ws[6] == 0 && ws[7] == 0){
+			unsigned char dc = clampSample(DESCALE(ws[0],IDCT_PASS1_BITS+3));
+			memset(out,dc,8);
+			continue;
+		}
+
+		int z2 = ws[2], z3 = ws[6];
+		int z1 = (z2 + z3) * FIX_0_541196100;
+		int tmp2 = z1 - z3 * FIX_1_847759065;
+		int tmp3 = z1 + z2 * FIX_0_765366865;
+		int tmp0 = (ws[0] + ws[4]) * (1 << IDCT_CONST_BITS);
+		int tmp1 = (ws[0] - ws[4]) * (1 << IDCT_CONST_BITS);
+		int tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+		int tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+
+		tmp0 = ws[7]; tmp1 = ws[5]; tmp2 = ws[3]; tmp3 = ws[1];
+		z1 = tmp0 + tmp3; z2 = tmp1 + tmp2;
+		z3 = tmp0 + tmp2; int z4 = tmp1 + tmp3;
+		int z5 = (z3 + z4) * FIX_1_175875602;
+		tmp0 *= FIX_0_298631336; tmp1 *= FIX_2_053119869;
+		tmp2 *= FIX_3_072711026; tmp3 *= FIX_1_501321110;
+		z1 *= -FIX_0_899976223; z2 *= -FIX_2_562915447;
+		z3 *= -FIX_1_961570560; z4 *= -FIX_0_390180644;
+		z3 += z5; z4 += z5;
+		tmp0 += z1 + z3; tmp1 += z2 + z4;
+		tmp2 += z2 + z3; tmp3 += z1 + z4;
+
+		const int shift = IDCT_CONST_BITS + IDCT_PASS1_BITS + 3;
+		out[0] = clampSample(DESCALE(tmp10 + tmp3,shift));
+		out[7] = clampSample(DESCALE(tmp10 - tmp3,shift));
+		out[1] = clampSample(DESCALE(tmp11 + tmp2,shift));
+		out[6] = clampSample(DESCALE(tmp11 - tmp2,shift));
+		out[2] = clampSample(DESCALE(tmp12 + tmp1,shift));
+		out[5] = clampSample(DESCALE(tmp12 - tmp1,shift));
+		out[3] = clampSample(DESCALE(tmp13 + tmp0,shift));
+		out[4] = clampSample(DESCALE(tmp13 - tmp0,shift));
+	}
+}
+
+#ifdef MJPEG_X86
+
+// pairs of 16-bit constants for _mm_madd_epi16
+static inline __m128i constPair(int a, int b)
+{
+	return _mm_set1_epi32((int) ((unsigned short) a | ((unsigned int) (unsigned short) b << 16)));
+}
+
+// one pass of the islow IDCT on the 8 lanes of in[0..7], the 8 inputs of each
+// lane's transform. lo and hi are the undescaled 32-bit outputs of lanes 0-3
+// and 4-7. the sums are rearranged into pairs for madd, which is exact
+static inline void idctPassSSE2(const __m128i * in, __m128i * lo, __m128i * hi)
+{
+	const __m128i c26a = constPair(FIX_0_541196100 + FIX_0_765366865,FIX_0_541196100);
+	const __m128i c26b = constPair(FIX_0_541196100,FIX_0_541196100 - FIX_1_847759065);
+	const __m128i c04a = constPair(1 << IDCT_CONST_BITS,1 << IDCT_CONST_BITS);
+	const __m128i c04b = constPair(1 << IDCT_CONST_BITS,-(1 << IDCT_CONST_BITS));
+	const __m128i c34a = constPair(FIX_1_175875602 - FIX_1_961570560,FIX_1_175875602);
+	const __m128i c34b = constPair(FIX_1_175875602,FIX_1_175875602 - FIX_0_390180644);
+	const __m128i c71a = constPair(FIX_0_298631336 - FIX_0_899976223,-FIX_0_899976223);
+	const __m128i c71b = constPair(-FIX_0_899976223,FIX_1_501321110 - FIX_0_899976223);
+	const __m128i c53a = constPair(FIX_2_053119869 - FIX_2_562915447,-FIX_2_562915447);
+	const __m128i c53b = constPair(-FIX_2_562915447,FIX_3_072711026 - FIX_2_562915447);
+
+	__m128i z3 = _mm_add_epi16(in[7],in[3]);
+	__m128i z4 = _mm_add_epi16(in[5],in[1]);
+
+	for(int half = 0; half < 2; half++){
+		__m128i * out = half ? hi : lo;
+		__m128i r26 = half ? _mm_unpackhi_epi16(in[2],in[6]) : _mm_unpacklo_epi16(in[2],in[6]);
+		__m128i r04 = half ? _mm_unpackhi_epi16(in[0],in[4]) : _mm_unpacklo_epi16(in[0],in[4]);
+		__m128i r34 = half ? _mm_unpackhi_epi16(z3,z4) : _mm_unpacklo_epi16(z3,z4);
+		__m128i r71 = half ? _mm_unpackhi_epi16(in[7],in[1]) : _mm_unpacklo_epi16(in[7],in[1]);
+		__m128i r53 = half ? _mm_unpackhi_epi16(in[5],in[3]) : _mm_unpacklo_epi16(in[5],in[3]);
+
+		// even part
+		__m128i tmp3 = _mm_madd_epi16(r26,c26a);
+		__m128i tmp2 = _mm_madd_epi16(r26,c26b);
+		__m128i tmp0 = _mm_madd_epi16(r04,c04a);
+		__m128i tmp1 = _mm_madd_epi16(r04,c04b);
+		__m128i tmp10 = _mm_add_epi32(tmp0,tmp3);
+		__m128i tmp13 = _mm_sub_epi32(tmp0,tmp3);
+		__m128i tmp11 = _mm_add_epi32(tmp1,tmp2);
+		__m128i tmp12 = _mm_sub_epi32(tmp1,tmp2);
+
+		// odd part
+		__m128i z3p = _mm_madd_epi16(r34,c34a);
+		__m128i z4p = _mm_madd_epi16(r34,c34b);
+		__m128i odd0 = _mm_add_epi32(_mm_madd_epi16(r71,c71a),z3p);
+		__m128i odd3 = _mm_add_epi32(_mm_madd_epi16(r71,c71b),z4p);
+		__m128i odd1 = _mm_add_epi32(_mm_madd_epi16(r53,c53a),z4p);
+		__m128i odd2 = _mm_add_epi32(_mm_madd_epi16(r53,c53b),z3p);
+
+		out[0] = _mm_add_epi32(tmp10,odd3);
+		out[7] = _mm_sub_epi32(tmp10,odd3);
+		out[1] = _mm_add_epi32(tmp11,odd2);
+		out[6] = _mm_sub_epi32(tmp11,odd2);
+		out[2] = _mm_add_epi32(tmp12,odd1);
+		out[5] = _mm_sub_epi32(tmp12,odd1);
+		out[3] = _mm_add_epi32(tmp13,odd0);
+		out[4] = _mm_sub_epi32(tmp13,odd0);
+	}
+}
+
+static inline void transpose8x8SSE2(__m128i * v)
+{
+	__m128i a0 = _mm_unpacklo_epi16(v[0],v[1]), a1 = _mm_unpackhi_epi16(v[0],v[1]);
+	__m128i a2 = _mm_unpacklo_epi16(v[2],v[3]), a3 = _mm_unpackhi_epi16(v[2],v[3]);
+	__m128i a4 = _mm_unpacklo_epi16(v[4],v[5]), a5 = _mm_unpackhi_epi16(v[4],v[5]);
+	__m128i a6 = _mm_unpacklo_epi16(v[6],v[7]), a7 = _mm_unpackhi_epi16(v[6],v[7]);
+	__m128i b0 = _mm_unpacklo_epi32(a0,a2), b1 = _mm_unpackhi_epi32(a0,a2);
+	__m128i b2 = _mm_unpacklo_epi32(a1,a3), b3 = _mm_unpackhi_epi32(a1,a3);
+	__m128i b4 = _mm_unpacklo_epi32(a4,a6), b5 = _mm_unpackhi_epi32(a4,a6);
+	__m128i b6 = _mm_unpacklo_epi32(a5,a7), b7 = _mm_unpackhi_epi32(a5,a7);
+	v[0] = _mm_unpacklo_epi64(b0,b4); v[1] = _mm_unpackhi_epi64(b0,b4);
+	v[2] = _mm_unpacklo_epi64(b1,b5); v[3] = _mm_unpackhi_epi64(b1,b5);
+	v[4] = _mm_unpacklo_epi64(b2,b6); v[5] = _mm_unpackhi_epi64(b2,b6);
+	v[6] = _mm_unpacklo_epi64(b3,b7); v[7] = _mm_unpackhi_epi64(b3,b7);
+}
+
+// ORs |x| (or |x|-1 for negative x) into magnitude, to check that values fit
+// in 15 bits, so that the 16-bit sums in idctPassSSE2 cannot overflow
+static inline __m128i orMagnitude(__m128i magnitude, __m128i x)
+{
+	return _mm_or_si128(magnitude,_mm_xor_si128(x,_mm_srai_epi32(x,31)));
+}
+
+static inline bool fitsIn15Bits(__m128i magnitude)
+{
+	return _mm_movemask_epi8(_mm_cmpgt_epi32(magnitude,_mm_set1_epi32(16383))) == 0;
+}
+
+// the same IDCT as inverseDCT, on 8 lanes. returns false, having written
+// nothing, for blocks with values too large for 16-bit lanes
+static bool inverseDCTSSE2(const int * in, unsigned char * out, int outStep)
+{
+	__m128i rows[8], lo[8], hi[8];
+	__m128i magnitude = _mm_setzero_si128();
+
+	for(int r = 0; r < 8; r++){
+		__m128i a = _mm_loadu_si128((const __m128i*) (in + 8*r));
+		__m128i b = _mm_loadu_si128((const __m128i*) (in + 8*r + 4));
+		magnitude = orMagnitude(orMagnitude(magnitude,a),b);
+		rows[r] = _mm_packs_epi32(a,b);
+	}
+	if(!fitsIn15Bits(magnitude)){
+		return false;
+	}
+
+	// columns: lanes are columns, rows[r] holds row r
+	idctPassSSE2(rows,lo,hi);
+	const __m128i round1 = _mm_set1_epi32(1 << (IDCT_CONST_BITS-IDCT_PASS1_BITS-1));
+	for(int r = 0; r < 8; r++){
+		__m128i a = _mm_srai_epi32(_mm_add_epi32(lo[r],round1),IDCT_CONST_BITS-IDCT_PASS1_BITS);
+		__m128i b = _mm_srai_epi32(_mm_add_epi32(hi[r],round1),IDCT_CONST_BITS-IDCT_PASS1_BITS);
+		magnitude = orMagnitude(orMagnitude(magnitude,a),b);
+		rows[r] = _mm_packs_epi32(a,b);
+	}
+	if(!fitsIn15Bits(magnitude)){
+		return false;
+	}
+
+	// rows: transpose so that lanes are rows
+	transpose8x8SSE2(rows);
+	idctPassSSE2(rows,lo,hi);
+	const int shift = IDCT_CONST_BITS + IDCT_PASS1_BITS + 3;
+	const __m128i round2 = _mm_set1_epi32(1 << (shift-1));
+	for(int c = 0; c < 8; c++){
+		__m128i a = _mm_srai_epi32(_mm_add_epi32(lo[c],round2),shift);
+		__m128i b = _mm_srai_epi32(_mm_add_epi32(hi[c],round2),shift);
+		rows[c] = _mm_packs_epi32(a,b);
+	}
+	transpose8x8SSE2(rows);
+
+	const __m128i center = _mm_set1_epi16(128);
+	for(int r = 0; r < 8; r += 2){
+		__m128i pixels = _mm_packus_epi16(_mm_adds_epi16(rows[r],center),_mm_adds_epi16(rows[r+1],center));
+		_mm_storel_epi64((__m128i*) (out + (ptrdiff_t) r * outStep),pixels);
+		_mm_storel_epi64((__m128i*) (out + (ptrdiff_t) (r+1) * outStep),_mm_srli_si128(pixels,8));
+	}
+	return true;
+}
+
+#endif
+
+// the value of an n-bit coefficient field
+static inline int extend(int v, int n)
+{
+	return v < (1 << (n-1)) ? v - (1 << n) + 1 : v;
+}
+
+// finds the next marker at or after p, skipping stuffed 0xFF 0x00 pairs
+static const unsigned char * findMarker(const unsigned char * p, const unsigned char * end)
+{
+	for(; p + 1 < end; p++){
+		if(p[0] == 0xFF && p[1] != 0x00 && p[1] != 0xFF){
+			return p;
+		}
+	}
+	return end;
+}
+
+mjpegDecoder::mjpegDecoder()
+{
+	memset(dcTables,0,sizeof(dcTables));
+	memset(acTables,0,sizeof(acTables));
+	memset(quantTables,0,sizeof(quantTables));
+	buildHuffmanTable(defaultDcTables[0],dcLumaCounts,dcValues);
+	buildHuffmanTable(defaultDcTables[1],dcChromaCounts,dcValues);
+	buildHuffmanTable(defaultAcTables[0],acLumaCounts,acLumaValues);
+	buildHuffmanTable(defaultAcTables[1],acChromaCounts,acChromaValues);
+	nComponents = 0;
+	maxH = maxV = 1;
+	imageWidth = imageHeight = 0;
+	restartInterval = 0;
+	useSSE2 = grayConvertKernel() != GrayConvertScalar;
+}
+
+bool mjpegDecoder::buildHuffmanTable(HuffmanTable &table, const unsigned char * counts, const unsigned char * values)
+{
+	int nValues = 0;
+	for(int len = 1; len <= 16; len++){
+		nValues += counts[len-1];
+	}
+	if(nValues > 256){
+		return false;
+	}
+	memcpy(table.values,values,nValues);
+	memset(table.lookup,0,sizeof(table.lookup));
+
+	// canonical codes: consecutive within a length, doubled between lengths
+	int code = 0, k = 0;
+	for(int len = 1; len <= 16; len++){
+		table.valueOffset[len] = k - code;
+		for(int i = 0; i < counts[len-1]; i++, code++, k++){
+			if(len <= MJPEGLOOKUPBITS){
+				int shift = MJPEGLOOKUPBITS - len;
+				for(int s = 0; s < (1 << shift); s++){
+					table.lookup[(code << shift) | s] = (unsigned short) ((len << 8) | values[k]);
+				}
+			}
+		}
+		if(code > (1 << len)){
+			return false;
+		}
+		table.maxCode[len] = counts[len-1] > 0 ? code - 1 : -1;
+		code <<= 1;
+	}
+	table.maxCode[17] = 0x7fffffff;
+
+	// AC codes that fit in the lookup together with their coefficient bits
+	for(int i = 0; i < (1 << MJPEGLOOKUPBITS); i++){
+		table.fastAC[i] = 0;
+		int len = table.lookup[i] >> 8, run = (table.lookup[i] >> 4) & 15, size = table.lookup[i] & 15;
+		if(len == 0 || size == 0 || len + size > MJPEGLOOKUPBITS){
+			continue;
+		}
+		int bits = (i >> (MJPEGLOOKUPBITS - len - size)) & ((1 << size) - 1);
+		table.fastAC[i] = extend(bits,size) * 256 + run * 16 + len + size;
+	}
+	table.defined = true;
+	return true;
+}
+
+bool mjpegDecoder::readHuffmanTables(const unsigned char * segment, int length)
+{
+	while(length >= 17){
+		int tableClass = segment[0] >> 4, id = segment[0] & 15;
+		const unsigned char * counts = segment + 1;
+		int nValues = 0;
+		for(int i = 0; i < 16; i++) nValues += counts[i];
+		if(tableClass > 1 || id > 3 || nValues > 256 || 17 + nValues > length){
+			return false;
+		}
+		HuffmanTable &table = tableClass == 0 ? dcTables[id] : acTables[id];
+		if(!buildHuffmanTable(table,counts,segment + 17)){
+			return false;
+		}
+		segment += 17 + nValues;
+		length -= 17 + nValues;
+	}
+	return length == 0;
+}
+
+bool mjpegDecoder::readQuantTables(const unsigned char * segment, int length)
+{
+	while(length >= 65){
+		int precision = segment[0] >> 4, id = segment[0] & 15;
+		int tableLength = precision ? 129 : 65;
+		if(id > 3 || tableLength > length){
+			return false;
+		}
+		for(int k = 0; k < 64; k++){
+			quantTables[id][zigzag[k]] = precision ? (unsigned short) ((segment[1+2*k] << 8) | segment[2+2*k]) : segment[1+k];
+		}
+		segment += tableLength;
+		length -= tableLength;
+	}
+	return length == 0;
+}
+
+void mjpegDecoder::fillBits(BitReader &reader)
+{
+	// whole bytes at once while there is no 0xFF among the next eight
+	if(!reader.atMarker && reader.end - reader.p >= 8 && reader.nBits > 0 && reader.nBits <= 56){
+		UINT64 word = 0;
+		for(int i = 0; i < 8; i++){
+			word = (word << 8) | reader.p[i];
+		}
+		UINT64 inverse = ~word;
+		if(((inverse - 0x0101010101010101ULL) & ~inverse & 0x8080808080808080ULL) == 0){
+			int nBytes = (64 - reader.nBits) >> 3;
+			reader.bits = (reader.bits << (8*nBytes)) | (word >> (64 - 8*nBytes));
+			reader.nBits += 8*nBytes;
+			reader.p += nBytes;
+			return;
+		}
+	}
+
+	while(reader.nBits <= 56){
+		unsigned int byte = 0;
+		if(!reader.atMarker && reader.p < reader.end){
+			byte = *reader.p;
+			if(byte != 0xFF){
+				reader.p++;
+			}
+			else if(reader.p + 1 < reader.end && reader.p[1] == 0x00){
+				reader.p += 2;
+			}
+			else{
+				// past the end of the data the decoder reads zeros
+				reader.atMarker = true;
+				byte = 0;
+			}
+		}
+		reader.bits = (reader.bits << 8) | byte;
+		reader.nBits += 8;
+	}
+}
+
+int mjpegDecoder::getBits(BitReader &reader, int n)
+{
+	if(n == 0){
+		return 0;
+	}
+	if(reader.nBits < n){
+		fillBits(reader);
+	}
+	reader.nBits -= n;
+	return (int) ((reader.bits >> reader.nBits) & ((1u << n) - 1));
+}
+
+void mjpegDecoder::skipBits(BitReader &reader, int n)
+{
+	if(reader.nBits < n){
+		fillBits(reader);
+	}
+	reader.nBits -= n;
+}
+
+int mjpegDecoder::decodeHuffman(BitReader &reader, const HuffmanTable &table)
+{
+	if(reader.nBits < 16){
+		fillBits(reader);
+	}
+	unsigned int look = (unsigned int) (reader.bits >> (reader.nBits - MJPEGLOOKUPBITS)) & ((1 << MJPEGLOOKUPBITS) - 1);
+	unsigned short entry = table.lookup[look];
+	if(entry != 0){
+		reader.nBits -= entry >> 8;
+		return entry & 0xFF;
+	}
+	for(int len = MJPEGLOOKUPBITS + 1; len <= 16; len++){
+		int code = (int) ((reader.bits >> (reader.nBits - len)) & ((1u << len) - 1));
+		if(table.maxCode[len] >= 0 && code <= table.maxCode[len]){
+			reader.nBits -= len;
+			return table.values[code + table.valueOffset[len]];
+		}
+	}
+	return -1;
+}
+
+bool mjpegDecoder::decodeBlock(BitReader &blockReader, Component &component, int &dcPredictor, int * coefficients, bool &dcOnly)
+{
+	// a local copy stays in registers, since coefficient stores cannot alias it
+	BitReader reader = blockReader;
+	const unsigned short * quant = quantTables[component.quantTable];
+
+	int s = decodeHuffman(reader,dcTables[component.dcTable]);
+	if(s < 0 || s > 11){
+		blockReader = reader;
+		return false;
+	}
+	if(s > 0){
+		dcPredictor += extend(getBits(reader,s),s);
+	}
+	coefficients[0] = dcPredictor * quant[0];
+	dcOnly = true;
+
+	const HuffmanTable &ac = acTables[component.acTable];
+	for(int k = 1; k < 64; ){
+		if(reader.nBits < 32){
+			fillBits(reader);
+		}
+		int fast = ac.fastAC[(reader.bits >> (reader.nBits - MJPEGLOOKUPBITS)) & ((1 << MJPEGLOOKUPBITS) - 1)];
+		if(fast != 0){
+			k += (fast >> 4) & 15;
+			reader.nBits -= fast & 15;
+			int pos = zigzag[k];
+			coefficients[pos] = (fast >> 8) * quant[pos];
+			dcOnly = false;
+			k++;
+			continue;
+		}
+
+		int rs = decodeHuffman(reader,ac);
+		if(rs < 0){
+			blockReader = reader;
+		return false;
+		}
+		int r = rs >> 4;
+		s = rs & 15;
+		if(s > 0){
+			k += r;
+			int pos = zigzag[k];
+			coefficients[pos] = extend(getBits(reader,s),s) * quant[pos];
+			dcOnly = false;
+			k++;
+		}
+		else if(r == 15){
+			k += 16;
+		}
+		else{
+			break;
+		}
+	}
+	blockReader = reader;
+	return true;
+}
+
+bool mjpegDecoder::skipBlock(BitReader &blockReader, Component &component)
+{
+	BitReader reader = blockReader;
+	int s = decodeHuffman(reader,dcTables[component.dcTable]);
+	if(s < 0 || s > 11){
+		blockReader = reader;
+		return false;
+	}
+	skipBits(reader,s);
+
+	const HuffmanTable &ac = acTables[component.acTable];
+	for(int k = 1; k < 64; ){
+		if(reader.nBits < 32){
+			fillBits(reader);
+		}
+		int fast = ac.fastAC[(reader.bits >> (reader.nBits - MJPEGLOOKUPBITS)) & ((1 << MJPEGLOOKUPBITS) - 1)];
+		if(fast != 0){
+			k += ((fast >> 4) & 15) + 1;
+			reader.nBits -= fast & 15;
+			continue;
+		}
+
+		int rs = decodeHuffman(reader,ac);
+		if(rs < 0){
+			blockReader = reader;
+		return false;
+		}
+		int r = rs >> 4;
+		s = rs & 15;
+		if(s > 0){
+			skipBits(reader,s);
+			k += r + 1;
+		}
+		else if(r == 15){
+			k += 16;
+		}
+		else{
+			break;
+		}
+	}
+	blockReader = reader;
+	return true;
+}
+
+static void transformBlock(const int * coefficients, unsigned char * out, int outStep, bool useSSE2)
+{
+#ifdef MJPEG_X86
+	if(useSSE2 && inverseDCTSSE2(coefficients,out,outStep)){
+		return;
+	}
+#endif
+	inverseDCT(coefficients,out,outStep);
+}
+
+// writes the 8x8 block at (x0,y0) of an image with the given visible size
+static void storeBlock(const int * coefficients, bool dcOnly, bool useSSE2, unsigned char * dst, int dstStep, int x0, int y0, int width, int height)
+{
+	if(x0 >= width || y0 >= height){
+		return;
+	}
+	unsigned char * out = dst + (ptrdiff_t) y0 * dstStep + x0;
+	int w = width - x0 < 8 ? width - x0 : 8;
+	int h = height - y0 < 8 ? height - y0 : 8;
+
+	// flat blocks, most of a fly arena's background, are what the IDCT
+	// would make of a lone DC coefficient
+	if(dcOnly){
+		unsigned char value = clampSample(DESCALE(coefficients[0] * (1 << IDCT_PASS1_BITS),IDCT_PASS1_BITS+3));
+		for(int y = 0; y < h; y++){
+			memset(out + (ptrdiff_t) y * dstStep,value,w);
+		}
+		return;
+	}
+	if(x0 + 8 <= width && y0 + 8 <= height){
+		transformBlock(coefficients,out,dstStep,useSSE2);
+		return;
+	}
+	// blocks on the right and bottom edges may be partly outside
+	unsigned char block[64];
+	transformBlock(coefficients,block,8,useSSE2);
+	for(int y = 0; y < h; y++){
+		memcpy(out + (ptrdiff_t) y * dstStep,block + 8*y,w);
+	}
+}
+
+bool mjpegDecoder::decodeScan(const unsigned char * &p, const unsigned char * end, const int * scanComponents, int nScanComponents,
+	unsigned char * dst, int dstStep, int width, int height)
+{
+	bool hasLuma = false;
+	for(int i = 0; i < nScanComponents; i++){
+		if(scanComponents[i] == 0) hasLuma = true;
+	}
+	// scans of chroma alone are skipped without decoding them
+	if(!hasLuma){
+		p = findMarker(p,end);
+		while(p + 1 < end && p[1] >= JPEG_RST0 && p[1] <= JPEG_RST7){
+			p = findMarker(p + 2,end);
+		}
+		return true;
+	}
+
+	BitReader reader;
+	reader.p = p;
+	reader.end = end;
+	reader.bits = 0;
+	reader.nBits = 0;
+	reader.atMarker = false;
+
+	int dcPredictors[4] = {0,0,0,0};
+	int coefficients[64];
+	memset(coefficients,0,sizeof(coefficients));
+
+	// a scan of one component codes its blocks in raster order; otherwise each
+	// MCU holds h x v blocks of each component
+	int mcusX, mcusY;
+	if(nScanComponents == 1){
+		mcusX = (imageWidth + 7) / 8;
+		mcusY = (imageHeight + 7) / 8;
+	}
+	else{
+		mcusX = (imageWidth + 8*maxH - 1) / (8*maxH);
+		mcusY = (imageHeight + 8*maxV - 1) / (8*maxV);
+	}
+
+	int mcusToRestart = restartInterval;
+	for(int my = 0; my < mcusY; my++){
+		for(int mx = 0; mx < mcusX; mx++){
+
+			if(restartInterval > 0){
+				if(mcusToRestart == 0){
+					// byte-aligned RSTn marker: reset the bit reader and the predictors
+					reader.p = findMarker(reader.p,end);
+					if(reader.p + 1 < end && reader.p[1] >= JPEG_RST0 && reader.p[1] <= JPEG_RST7){
+						reader.p += 2;
+					}
+					reader.bits = 0;
+					reader.nBits = 0;
+					reader.atMarker = false;
+					memset(dcPredictors,0,sizeof(dcPredictors));
+					mcusToRestart = restartInterval;
+				}
+				mcusToRestart--;
+			}
+
+			for(int i = 0; i < nScanComponents; i++){
+				int c = scanComponents[i];
+				Component &component = components[c];
+				int blocksH = nScanComponents == 1 ? 1 : component.h;
+				int blocksV = nScanComponents == 1 ? 1 : component.v;
+				for(int v = 0; v < blocksV; v++){
+					for(int h = 0; h < blocksH; h++){
+						if(c != 0){
+							if(!skipBlock(reader,component)) return false;
+							continue;
+						}
+						bool dcOnly;
+						if(!decodeBlock(reader,component,dcPredictors[i],coefficients,dcOnly)) return false;
+						storeBlock(coefficients,dcOnly,useSSE2,dst,dstStep,8*(mx*blocksH + h),8*(my*blocksV + v),width,height);
+						if(!dcOnly){
+							memset(coefficients,0,sizeof(coefficients));
+						}
+					}
+				}
+			}
+		}
+	}
+
+	p = findMarker(reader.p,end);
+	return true;
+}
+
+bool mjpegDecoder::decodeImage(const unsigned char * &p, const unsigned char * end, unsigned char * dst, int dstStep, int width, int height)
+{
+	if(end - p < 2 || p[0] != 0xFF || p[1] != JPEG_SOI){
+		return false;
+	}
+	p += 2;
+	nComponents = 0;
+	restartInterval = 0;
+	bool lumaDecoded = false;
+
+	// a DHT only holds for the JPEG it is in, so that a frame without one
+	// is decoded with the standard tables rather than the last frame's
+	memcpy(dcTables,defaultDcTables,sizeof(defaultDcTables));
+	memcpy(acTables,defaultAcTables,sizeof(defaultAcTables));
+	for(int i = 2; i < 4; i++){
+		dcTables[i].defined = false;
+		acTables[i].defined = false;
+	}
+
+	for(;;){
+		// markers may be padded with any number of 0xFF
+		while(p < end && *p != 0xFF) p++;
+		while(p < end && *p == 0xFF) p++;
+		if(p >= end){
+			// some capture cards leave out the EOI
+			return lumaDecoded;
+		}
+		int marker = *p++;
+		if(marker == JPEG_EOI){
+			return lumaDecoded;
+		}
+		if(marker >= JPEG_RST0 && marker <= JPEG_RST7){
+			continue;
+		}
+		if(end - p < 2){
+			return false;
+		}
+		int length = (p[0] << 8) | p[1];
+		if(length < 2 || length > end - p){
+			return false;
+		}
+		const unsigned char * segment = p + 2;
+		int segmentLength = length - 2;
+		p += length;
+
+		switch(marker){
+
+		case JPEG_SOF0:
+		case JPEG_SOF1:
+			if(segmentLength < 6 || segment[0] != 8){
+				return false;
+			}
+			imageHeight = (segment[1] << 8) | segment[2];
+			imageWidth = (segment[3] << 8) | segment[4];
+			nComponents = segment[5];
+			if(nComponents < 1 || nComponents > 4 || segmentLength < 6 + 3*nComponents){
+				return false;
+			}
+			maxH = maxV = 1;
+			for(int i = 0; i < nComponents; i++){
+				Component &component = components[i];
+				component.id = segment[6+3*i];
+				component.h = segment[7+3*i] >> 4;
+				component.v = segment[7+3*i] & 15;
+				component.quantTable = segment[8+3*i] & 3;
+				if(component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4){
+					return false;
+				}
+				if(component.h > maxH) maxH = component.h;
+				if(component.v > maxV) maxV = component.v;
+			}
+			// luma must be at full resolution and fill the whole frame
+			if(components[0].h != maxH || components[0].v != maxV ||
+				imageWidth != width || imageHeight < height){
+				return false;
+			}
+			break;
+
+		case JPEG_DHT:
+			if(!readHuffmanTables(segment,segmentLength)){
+				return false;
+			}
+			break;
+
+		case JPEG_DQT:
+			if(!readQuantTables(segment,segmentLength)){
+				return false;
+			}
+			break;
+
+		case JPEG_DRI:
+			if(segmentLength < 2){
+				return false;
+			}
+			restartInterval = (segment[0] << 8) | segment[1];
+			break;
+
+		case JPEG_SOS:
+			{
+				if(nComponents == 0 || segmentLength < 1){
+					return false;
+				}
+				int nScanComponents = segment[0];
+				if(nScanComponents < 1 || nScanComponents > nComponents || segmentLength < 4 + 2*nScanComponents){
+					return false;
+				}
+				int scanComponents[4];
+				for(int i = 0; i < nScanComponents; i++){
+					int id = segment[1+2*i], c;
+					for(c = 0; c < nComponents; c++){
+						if(components[c].id == id) break;
+					}
+					if(c == nComponents){
+						return false;
+					}
+					components[c].dcTable = segment[2+2*i] >> 4;
+					components[c].acTable = segment[2+2*i] & 15;
+					if(components[c].dcTable > 3 || components[c].acTable > 3 ||
+						!dcTables[components[c].dcTable].defined || !acTables[components[c].acTable].defined){
+						return false;
+					}
+					scanComponents[i] = c;
+				}
+				// baseline scans code all coefficients at full precision
+				const unsigned char * spectral = segment + 1 + 2*nScanComponents;
+				if(spectral[0] != 0 || spectral[1] != 63 || spectral[2] != 0){
+					return false;
+				}
+				if(!decodeScan(p,end,scanComponents,nScanComponents,dst,dstStep,width,height)){
+					return false;
+				}
+				for(int i = 0; i < nScanComponents; i++){
+					if(scanComponents[i] == 0) lumaDecoded = true;
+				}
+			}
+			break;
+
+		default:
+			// progressive, lossless and arithmetic-coded JPEGs are not handled.
+			// APPn, COM and the rest are skipped
+			if(marker >= 0xC2 && marker <= 0xCF && marker != JPEG_DHT && marker != 0xC8 && marker != 0xCC){
+				return false;
+			}
+			break;
+		}
+	}
+}
+
+// finds the image size in the SOF segment of the JPEG in data
+static bool jpegImageSize(const unsigned char * p, const unsigned char * end, int &width, int &height)
+{
+	if(end - p < 2 || p[0] != 0xFF || p[1] != JPEG_SOI){
+		return false;
+	}
+	p += 2;
+	while(end - p >= 4){
+		if(p[0] != 0xFF){
+			return false;
+		}
+		int marker = p[1];
+		if(marker == 0xFF){
+			p++;
+			continue;
+		}
+		int length = (p[2] << 8) | p[3];
+		if(marker >= 0xC0 && marker <= 0xCF && marker != JPEG_DHT && marker != 0xC8 && marker != 0xCC){
+			if(length < 7 || end - p < 9) return false;
+			height = (p[5] << 8) | p[6];
+			width = (p[7] << 8) | p[8];
+			return true;
+		}
+		if(marker == JPEG_SOS || marker == JPEG_EOI){
+			return false;
+		}
+		p += 2 + length;
+	}
+	return false;
+}
+
+bool mjpegDecoder::decode(const unsigned char * data, size_t size, unsigned char * dst, int dstStep, int width, int height)
+{
+	const unsigned char * p = data;
+	const unsigned char * end = data + size;
+	int jpegWidth, jpegHeight;
+	if(!jpegImageSize(p,end,jpegWidth,jpegHeight)){
+		return false;
+	}
+
+	// interlaced MJPEG stores each field as its own JPEG, one after the other
+	if(jpegHeight >= height * 3 / 4){
+		return decodeImage(p,end,dst,dstStep,width,height);
+	}
+	if(!decodeImage(p,end,dst,2*dstStep,width,(height + 1) / 2)){
+		return false;
+	}
+	while(p + 1 < end && !(p[0] == 0xFF && p[1] == JPEG_SOI)){
+		p++;
+	}
+	return decodeImage(p,end,dst + dstStep,2*dstStep,width,height / 2);
+}
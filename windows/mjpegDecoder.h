@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "winCompat.h"
+
+// codes up to this long are decoded with a single table lookup
+#define MJPEGLOOKUPBITS 9
+
+// mjpegDecoder decodes only the luma of baseline JPEG frames, as found in
+// MJPEG AVIs. Chroma blocks are Huffman-decoded just far enough to find the
+// next luma block; they are never dequantized, transformed or upsampled, and
+// chroma-only scans are skipped without decoding. Frames without Huffman
+// tables use the standard tables, as MJPEG allows. Interlaced MJPEG, with two
+// half-height fields per frame, is woven into one frame with the first field
+// on the even rows. The IDCT is the accurate integer one of the IJG library,
+// with an SSE2 version that gives the same result
+class mjpegDecoder {
+
+public:
+
+	mjpegDecoder();
+
+	// decodes the frame in data into the width x height gray image dst.
+	// returns false for JPEGs that are not baseline, whose size does not
+	// match, or that are corrupt
+	bool decode(const unsigned char * data, size_t size, unsigned char * dst, int dstStep, int width, int height);
+
+private:
+
+	typedef struct {
+		bool defined;
+		// (code length << 8) | symbol for codes of up to MJPEGLOOKUPBITS
+		// bits, 0 for longer codes
+		unsigned short lookup[1 << MJPEGLOOKUPBITS];
+		// for AC tables, coefficient * 256 + run * 16 + total length of
+		// codes that fit in the lookup with their coefficient bits
+		int fastAC[1 << MJPEGLOOKUPBITS];
+		// canonical decoding of longer codes
+		int maxCode[18];
+		int valueOffset[17];
+		unsigned char values[256];
+	} HuffmanTable;
+
+	typedef struct {
+		int id;
+		int h;
+		int v;
+		int quantTable;
+		int dcTable;
+		int acTable;
+	} Component;
+
+	// entropy-coded data reader, which stops at the next marker
+	typedef struct {
+		const unsigned char * p;
+		const unsigned char * end;
+		UINT64 bits;
+		int nBits;
+		bool atMarker;
+	} BitReader;
+
+	bool decodeImage(const unsigned char * &p, const unsigned char * end, unsigned char * dst, int dstStep, int width, int height);
+	bool decodeScan(const unsigned char * &p, const unsigned char * end, const int * scanComponents, int nScanComponents,
+		unsigned char * dst, int dstStep, int width, int height);
+	bool readHuffmanTables(const unsigned char * segment, int length);
+	bool readQuantTables(const unsigned char * segment, int length);
+	bool buildHuffmanTable(HuffmanTable &table, const unsigned char * counts, const unsigned char * values);
+
+	void fillBits(BitReader &reader);
+	int decodeHuffman(BitReader &reader, const HuffmanTable &table);
+	int getBits(BitReader &reader, int n);
+	void skipBits(BitReader &reader, int n);
+	bool decodeBlock(BitReader &reader, Component &component, int &dcPredictor, int * coefficients, bool &dcOnly);
+	bool skipBlock(BitReader &reader, Component &component);
+
+	HuffmanTable dcTables[4];
+	HuffmanTable acTables[4];
+	// the standard tables as slots 0 and 1, which every frame starts from
+	HuffmanTable defaultDcTables[2];
+	HuffmanTable defaultAcTables[2];
+	unsigned short quantTables[4][64];
+
+	Component components[4];
+	int nComponents;
+	int maxH;
+	int maxV;
+	int imageWidth;
+	int imageHeight;
+	int restartInterval;
+
+	// the IDCT uses SSE2 where grayConvert found it
+	bool useSSE2;
+};
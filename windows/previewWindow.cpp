@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "previewWindow.h"
+
+previewWindow::previewWindow(const char * windowName)
+{
+	strncpy(this->windowName,windowName,sizeof(this->windowName)-1);
+	this->windowName[sizeof(this->windowName)-1] = '\0';
+	thread = NULL;
+	stopRequested = 0;
+	escPressed = 0;
+}
+
+previewWindow::~previewWindow()
+{
+	stop();
+}
+
+bool previewWindow::start()
+{
+	thread = CreateThread(NULL,0,previewThread,this,0,NULL);
+	if(thread == NULL){
+		fprintf(stderr,"Error starting preview thread\n");
+		return false;
+	}
+	return true;
+}
+
+bool previewWindow::stop()
+{
+	if(thread == NULL){
+		return true;
+	}
+	InterlockedExchange(&stopRequested,1);
+	bool success = WaitForSingleObject(thread,INFINITE) == WAIT_OBJECT_0;
+	CloseHandle(thread);
+	thread = NULL;
+	return success;
+}
+
+bool previewWindow::setFrame(const IplImage * frame)
+{
+	if(escPressed){
+		return false;
+	}
+	mailbox.put(frame);
+	return true;
+}
+
+DWORD WINAPI previewWindow::previewThread(LPVOID param)
+{
+	((previewWindow*) param)->previewLoop();
+	return 0;
+}
+
+void previewWindow::previewLoop()
+{
+	// highgui windows must be created, drawn and destroyed on the same thread
+	cvNamedWindow(windowName,CV_WINDOW_AUTOSIZE);
+	while(!stopRequested){
+		IplImage * frame = mailbox.take();
+		if(frame != NULL){
+			cvShowImage(windowName,frame);
+		}
+		int key = cvWaitKey(PREVIEWPERIODMS);
+		if((key & 0xff) == 27){
+			InterlockedExchange(&escPressed,1);
+		}
+	}
+	cvDestroyWindow(windowName);
+}
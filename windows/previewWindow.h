@@ -0,0 +1,39 @@
+#pragma once
+
+#include "winCompat.h"
+
+#include "cv.h"
+#include "highgui.h"
+#include "frameMailbox.h"
+
+// how often the preview window is redrawn
+#define PREVIEWPERIODMS 30
+
+// previewWindow shows the frames being converted in a highgui window that is
+// owned and redrawn by its own thread. Frames are passed through a
+// frameMailbox, so the preview picks up the latest frame at its own pace and
+// the decoder never waits on the window
+class previewWindow {
+
+public:
+
+	previewWindow(const char * windowName);
+	~previewWindow();
+
+	bool start();
+	bool stop();
+
+	// never blocks. returns false once the user has hit esc in the window
+	bool setFrame(const IplImage * frame);
+
+private:
+
+	static DWORD WINAPI previewThread(LPVOID param);
+	void previewLoop();
+
+	char windowName[256];
+	frameMailbox mailbox;
+	HANDLE thread;
+	volatile LONG stopRequested;
+	volatile LONG escPressed;
+};
@@ -0,0 +1,120 @@
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#include "rawFrameSource.h"
+
+rawFrameSource::rawFrameSource(UINT32 width, UINT32 height, bool timestamped)
+{
+	fp = NULL;
+	this->width = width;
+	this->height = height;
+	this->timestamped = timestamped;
+	nextFrameIndex = 0;
+	timestamp = 0;
+	readError = false;
+	grayFrame = NULL;
+}
+
+rawFrameSource::~rawFrameSource()
+{
+	if(fp != NULL && fp != stdin){
+		fclose(fp);
+	}
+	fp = NULL;
+	if(grayFrame != NULL){
+		cvReleaseImage(&grayFrame);
+	}
+}
+
+bool rawFrameSource::open(const char * fileName)
+{
+	if(width == 0 || height == 0){
+		return false;
+	}
+
+	if(strcmp(fileName,"-") == 0){
+		fp = stdin;
+#ifdef _WIN32
+		// stdin is opened in text mode, which would mangle frames
+		_setmode(_fileno(stdin),_O_BINARY);
+#endif
+	}
+	else{
+		fp = fopen(fileName,"rb");
+	}
+	if(fp == NULL){
+		return false;
+	}
+
+	grayFrame = cvCreateImage(cvSize(width,height),IPL_DEPTH_8U,1);
+	nextFrameIndex = 0;
+	return true;
+}
+
+bool rawFrameSource::seek(UINT64 frameNumber)
+{
+	// a pipe cannot be rewound or skipped through
+	return frameNumber == nextFrameIndex;
+}
+
+bool rawFrameSource::nextFrameInto(IplImage * gray)
+{
+	if(timestamped){
+		unsigned char bytes[8];
+		size_t n = fread(bytes,1,8,fp);
+		if(n == 0){
+			readError = ferror(fp) != 0;
+			return false;
+		}
+		if(n != 8){
+			fprintf(stderr,"Stream ended inside the timestamp of frame %lu\n",(unsigned long) nextFrameIndex);
+			readError = true;
+			return false;
+		}
+		memcpy(&timestamp,bytes,8);
+	}
+
+	// a frame without padding is read in one go, which the C library passes
+	// straight to the OS without going through the stdio buffer
+	size_t n;
+	if(gray->widthStep == (int) width){
+		n = fread(gray->imageData,1,(size_t) width*height,fp);
+	}
+	else{
+		n = 0;
+		for(UINT32 y = 0; y < height; y++){
+			size_t nRow = fread(gray->imageData + (size_t) y * gray->widthStep,1,width,fp);
+			n += nRow;
+			if(nRow != width) break;
+		}
+	}
+	if(n == 0 && !timestamped){
+		readError = ferror(fp) != 0;
+		return false;
+	}
+	if(n != (size_t) width*height){
+		fprintf(stderr,"Stream ended inside frame %lu, which is dropped\n",(unsigned long) nextFrameIndex);
+		readError = true;
+		return false;
+	}
+	nextFrameIndex++;
+	return true;
+}
+
+IplImage * rawFrameSource::nextFrame()
+{
+	return nextFrameInto(grayFrame) ? grayFrame : NULL;
+}
+
+bool rawFrameSource::getTimestamp(double &timestamp)
+{
+	if(!timestamped){
+		return false;
+	}
+	timestamp = this->timestamp;
+	return true;
+}
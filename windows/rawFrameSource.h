@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "frameSource.h"
+
+// rawFrameSource reads a stream of raw 8-bit gray frames of a size given on
+// the command line, top row first and without padding, from stdin ("-") or
+// from a file or named pipe, such as the output of
+// ffmpeg -f rawvideo -pix_fmt gray. If timestamped, every frame is preceded
+// by its timestamp as a little-endian 8-byte double. Frames are read
+// straight into the frame that goes to the writer. The stream can only be
+// read forward, and its length is not known in advance
+class rawFrameSource : public frameSource {
+
+public:
+
+	rawFrameSource(UINT32 width, UINT32 height, bool timestamped);
+	~rawFrameSource();
+
+	bool open(const char * fileName);
+
+	UINT32 getWidth() { return width; }
+	UINT32 getHeight() { return height; }
+	UINT64 getFrameCount() { return 0; }
+	const char * getName() { return "raw stream"; }
+
+	bool seek(UINT64 frameNumber);
+	IplImage * nextFrame();
+	bool framesPersist() { return false; }
+	bool decodesToGray() { return true; }
+	bool nextFrameInto(IplImage * gray);
+	bool getTimestamp(double &timestamp);
+	bool failed() { return readError; }
+
+private:
+
+	FILE * fp;
+	UINT32 width;
+	UINT32 height;
+	bool timestamped;
+
+	UINT64 nextFrameIndex;
+	double timestamp;
+	// the stream ended inside a frame or could not be read
+	bool readError;
+
+	// where nextFrame puts frames
+	IplImage * grayFrame;
+};
@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "transcode.h"
+#include "ufmfStitch.h"
+
+bool transcodeFrames(decodeAhead * decoder, ufmfWriter * writer, double frameRate, UINT64 &endFrame)
+{
+	UINT64 frameNumber;
+	IplImage * frameWrite = NULL;
+
+	for(;;){
+
+		frameWrite = decoder->getFrame(frameNumber);
+		endFrame = frameNumber;
+		if(frameWrite == NULL){
+			fprintf(stderr,"Last frame read = %lu\n",(unsigned long) frameNumber);
+			// mostly waits for the writer means compression is the bottleneck,
+			// mostly waits for the decoder means reading the video is
+			fprintf(stderr,"Decoder waited for the writer %lu times, writer waited for the decoder %lu times\n",
+				(unsigned long) decoder->getDecoderWaits(),(unsigned long) decoder->getWriterWaits());
+			if(decoder->failed()){
+				fprintf(stderr,"Error reading frame %lu, the video was not converted to the end\n",(unsigned long) frameNumber);
+				return false;
+			}
+			return true;
+		}
+
+		if((frameNumber % 100) == 0){
+			fprintf(stderr,"** frame %lu\n",(unsigned long) frameNumber);
+		}
+
+		// addFrame reads the frame as width*height bytes, so padded rows would
+		// shear the movie
+		if(frameWrite->widthStep != frameWrite->width){
+			fprintf(stderr,"Frame %lu has %d bytes per row for a width of %d\n",
+				(unsigned long) frameNumber,frameWrite->widthStep,frameWrite->width);
+			return false;
+		}
+
+		double timestamp;
+		if(!decoder->getTimestamp(timestamp)){
+			timestamp = frameNumber*frameRate;
+		}
+		if(!writer->addFrame((unsigned char*) frameWrite->imageData,timestamp)){
+			fprintf(stderr,"Error adding frame %lu\n",(unsigned long) frameNumber);
+			return false;
+		}
+		decoder->releaseFrame();
+
+	}
+}
+
+typedef struct {
+	char aviFileName[512];
+	char fragmentFileName[512];
+	char ufmfParamsFileName[512];
+	bool nativeAVI;
+	CvRect roi;
+	const arenaMask * mask;
+	UINT64 firstFrame;
+	UINT64 endFrame;
+	bool lastChunk;
+	int decodeAheadDepth;
+	double frameRate;
+	FILE * logFID;
+	bool success;
+} ChunkJob;
+
+// if line sets the parameter name, returns its value with the surrounding
+// white space removed, else NULL. line is modified
+static char * paramValue(char * line, const char * name)
+{
+	char * p = line;
+	while(*p == ' ' || *p == '\t') p++;
+	size_t n = strlen(name);
+	if(strncmp(p,name,n) != 0 || (p[n] != ' ' && p[n] != '\t' && p[n] != '=')){
+		return NULL;
+	}
+	p = strchr(p,'=');
+	if(p == NULL){
+		return NULL;
+	}
+	p++;
+	while(*p == ' ' || *p == '\t') p++;
+	size_t end = strlen(p);
+	while(end > 0 && (p[end-1] == '\n' || p[end-1] == '\r' || p[end-1] == ' ' || p[end-1] == '\t')) end--;
+	p[end] = '\0';
+	return p;
+}
+
+// writes the parameters chunk of nChunks is compressed with: those in
+// ufmfParamsFileName, if any, with a statistics file of its own so that the
+// writers do not write over each other, and with an equal share of the
+// compression threads, so that all chunks together use as many as a single
+// writer would
+static bool writeChunkParams(const char * ufmfParamsFileName, const char * chunkParamsFileName,
+	const char * fragmentFileName, int chunk, int nChunks)
+{
+	FILE * out = fopen(chunkParamsFileName,"w");
+	if(out == NULL){
+		fprintf(stderr,"Error writing parameters file %s\n",chunkParamsFileName);
+		return false;
+	}
+
+	char statFileName[1024];
+	sprintf(statFileName,"%s.stats.txt",fragmentFileName);
+	int nThreads = 0;
+	if(strlen(ufmfParamsFileName) > 0){
+		FILE * in = fopen(ufmfParamsFileName,"r");
+		if(in == NULL){
+			fprintf(stderr,"Error reading parameters file %s\n",ufmfParamsFileName);
+			fclose(out);
+			return false;
+		}
+		char line[1024], value[1024];
+		while(fgets(line,sizeof(line),in) != NULL){
+			strcpy(value,line);
+			char * p;
+			if((p = paramValue(value,"UFMFStatFileName")) != NULL){
+				if(strlen(p) > 0 && strlen(p) < sizeof(statFileName) - 16){
+					sprintf(statFileName,"%s.part%d",p,chunk);
+				}
+			}
+			else if((p = paramValue(value,"UFMFNThreads")) != NULL){
+				nThreads = atoi(p);
+			}
+			else{
+				fputs(line,out);
+			}
+		}
+		fclose(in);
+	}
+	if(nThreads < 1){
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		nThreads = (int) info.dwNumberOfProcessors;
+	}
+	nThreads /= nChunks;
+	if(nThreads < 1) nThreads = 1;
+
+	fprintf(out,"\n# set by any2ufmf for chunk %d of %d\n",chunk,nChunks);
+	fprintf(out,"UFMFStatFileName = %s\n",statFileName);
+	fprintf(out,"UFMFNThreads = %d\n",nThreads);
+	bool success = ferror(out) == 0;
+	if(fclose(out) != 0 || !success){
+		fprintf(stderr,"Error writing parameters file %s\n",chunkParamsFileName);
+		return false;
+	}
+	return true;
+}
+
+static DWORD WINAPI chunkThread(LPVOID param)
+{
+	ChunkJob * job = (ChunkJob*) param;
+	job->success = false;
+
+	frameSource * source = openFrameSource(job->aviFileName,job->nativeAVI);
+	if(source == NULL){
+		fprintf(stderr,"Error reading AVI %s\n",job->aviFileName);
+		return 0;
+	}
+
+	if(!source->seek(job->firstFrame)){
+		fprintf(stderr,"Error seeking to frame %lu. Convert this video without --chunks.\n",(unsigned long) job->firstFrame);
+		delete source;
+		return 0;
+	}
+
+	ufmfWriter * writer = new ufmfWriter(job->fragmentFileName, job->roi.width, job->roi.height, job->logFID, job->ufmfParamsFileName);
+	decodeAhead * decoder = new decodeAhead(source, job->roi, job->decodeAheadDepth, NULL);
+	decoder->setMask(job->mask);
+	decoder->setFrameRange(job->firstFrame,job->endFrame);
+
+	if(!writer->startWrite()){
+		fprintf(stderr,"Error starting write of %s\n",job->fragmentFileName);
+	}
+	else{
+		UINT64 endFrame = job->firstFrame;
+		if(decoder->start()){
+			job->success = transcodeFrames(decoder,writer,job->frameRate,endFrame);
+		}
+		if(!decoder->stop()){
+			job->success = false;
+		}
+		if(!writer->stopWrite()){
+			fprintf(stderr,"Error stopping writing of %s\n",job->fragmentFileName);
+			job->success = false;
+		}
+		// only the last chunk may end early, anywhere else it would leave a gap
+		if(job->success && !job->lastChunk && endFrame != job->endFrame){
+			fprintf(stderr,"Chunk of frames %lu to %lu ended at frame %lu\n",
+				(unsigned long) job->firstFrame,(unsigned long) job->endFrame,(unsigned long) endFrame);
+			job->success = false;
+		}
+	}
+
+	delete decoder;
+	delete writer;
+	delete source;
+	return 0;
+}
+
+bool transcodeInChunks(const char * aviFileName, const char * ufmfFileName, const char * ufmfParamsFileName, bool nativeAVI,
+	CvRect roi, const arenaMask * mask, UINT64 nFrames, int nChunks,
+	int decodeAheadDepth, double frameRate, FILE * logFID)
+{
+	if(nFrames < (UINT64) nChunks){
+		nChunks = nFrames > 0 ? (int) nFrames : 1;
+	}
+
+	ChunkJob * jobs = new ChunkJob[nChunks];
+	HANDLE * threads = new HANDLE[nChunks];
+	char ** fragmentFileNames = new char*[nChunks];
+
+	for(int i = 0; i < nChunks; i++){
+		ChunkJob * job = &jobs[i];
+		strcpy(job->aviFileName,aviFileName);
+		sprintf(job->fragmentFileName,"%s.part%d",ufmfFileName,i);
+		sprintf(job->ufmfParamsFileName,"%s.params.txt",job->fragmentFileName);
+		job->nativeAVI = nativeAVI;
+		job->roi = roi;
+		job->mask = mask;
+		// chunks differ in length by at most a frame, so none is empty and
+		// every one ends inside the video. the last chunk reads to the end,
+		// in case the frame count was low
+		job->firstFrame = i*nFrames/nChunks;
+		job->lastChunk = i == nChunks-1;
+		job->endFrame = job->lastChunk ? (UINT64) -1 : (i+1)*nFrames/nChunks;
+		job->decodeAheadDepth = decodeAheadDepth;
+		job->frameRate = frameRate;
+		job->logFID = logFID;
+		job->success = false;
+		fragmentFileNames[i] = job->fragmentFileName;
+
+		fprintf(stderr,"Chunk %d: frames %lu to %lu -> %s\n",i,(unsigned long) job->firstFrame,
+			(unsigned long) (job->lastChunk ? nFrames : job->endFrame),job->fragmentFileName);
+		threads[i] = NULL;
+		if(!writeChunkParams(ufmfParamsFileName,job->ufmfParamsFileName,job->fragmentFileName,i,nChunks)){
+			continue;
+		}
+		threads[i] = CreateThread(NULL,0,chunkThread,job,0,NULL);
+		if(threads[i] == NULL){
+			fprintf(stderr,"Error starting thread for chunk %d\n",i);
+		}
+	}
+
+	bool success = true;
+	for(int i = 0; i < nChunks; i++){
+		if(threads[i] == NULL || WaitForSingleObject(threads[i],INFINITE) != WAIT_OBJECT_0 || !jobs[i].success){
+			fprintf(stderr,"Error converting chunk %d\n",i);
+			success = false;
+		}
+		if(threads[i] != NULL){
+			CloseHandle(threads[i]);
+		}
+	}
+
+	if(success){
+		fprintf(stderr,"Stitching %d chunks into %s\n",nChunks,ufmfFileName);
+		success = stitchUfmf(ufmfFileName,fragmentFileNames,nChunks,logFID);
+	}
+	// fragments and their parameters are kept when something went wrong
+	if(success){
+		for(int i = 0; i < nChunks; i++){
+			remove(fragmentFileNames[i]);
+			remove(jobs[i].ufmfParamsFileName);
+		}
+	}
+
+	delete [] fragmentFileNames;
+	delete [] threads;
+	delete [] jobs;
+	return success;
+}
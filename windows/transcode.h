@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "winCompat.h"
+#include "ufmfWriter.h"
+#include "decodeAhead.h"
+
+// adds every frame the decoder produces to the writer, with the timestamp the
+// source gave it or else frame n with timestamp n * frameRate. endFrame is set
+// to the number of the first frame that was not written. returns false if the
+// video could not be read to its end or the writer failed
+bool transcodeFrames(decodeAhead * decoder, ufmfWriter * writer, double frameRate, UINT64 &endFrame);
+
+// splits the video into nChunks consecutive frame ranges and converts them in
+// parallel, each with its own frame source, decoder and writer, then stitches
+// the resulting fragments into ufmfFileName. nativeAVI is passed on to
+// openFrameSource, roi and mask to decodeAhead. mask may be NULL. each writer
+// gets a copy of ufmfParamsFileName with its own statistics file and a share
+// of UFMFNThreads
+bool transcodeInChunks(const char * aviFileName, const char * ufmfFileName, const char * ufmfParamsFileName, bool nativeAVI,
+	CvRect roi, const arenaMask * mask, UINT64 nFrames, int nChunks,
+	int decodeAheadDepth, double frameRate, FILE * logFID);
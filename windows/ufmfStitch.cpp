@@ -0,0 +1,305 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "winCompat.h"
+#include "ufmfStitch.h"
+
+#ifdef _WIN32
+#define ufmfSeek _fseeki64
+#define ufmfTell _ftelli64
+#else
+#define ufmfSeek fseeko
+#define ufmfTell ftello
+#endif
+
+#define UFMFINDEXCHUNK 2
+#define UFMFMAXHEADERLENGTH (4+4+8+2+2+1+1+255)
+#define UFMFINDEXLOCOFFSET 8
+#define UFMFMAXSIZEOFFSET 16
+#define STITCHCOPYBUFFERSIZE (4*1024*1024)
+
+// ufmf files are little-endian, like every machine any2ufmf runs on, so
+// fields are read and written with memcpy
+
+typedef struct {
+	unsigned char raw[UFMFMAXHEADERLENGTH];
+	int length;
+	UINT32 version;
+	UINT64 indexLocation;
+	unsigned short maxSize[2];
+} UfmfHeader;
+
+// one key of the index dictionary: either a nested dictionary or an array
+typedef struct UfmfIndexEntry {
+	std::string name;
+	bool isDict;
+	std::vector<UfmfIndexEntry> children;
+	char dtype;
+	std::vector<unsigned char> data;
+} UfmfIndexEntry;
+
+static bool readHeader(FILE * fp, UfmfHeader &header)
+{
+	unsigned char * raw = header.raw;
+	if(fread(raw,1,16+4,fp) != 16+4 || memcmp(raw,"ufmf",4) != 0){
+		return false;
+	}
+	memcpy(&header.version,raw+4,4);
+	memcpy(&header.indexLocation,raw+UFMFINDEXLOCOFFSET,8);
+	memcpy(header.maxSize,raw+UFMFMAXSIZEOFFSET,4);
+	header.length = 16+4;
+
+	// version 4 added a byte saying whether boxes have a fixed size
+	if(header.version == 4){
+		if(fread(raw+header.length,1,1,fp) != 1) return false;
+		header.length++;
+	}
+	else if(header.version != 3){
+		return false;
+	}
+
+	// coding string
+	if(fread(raw+header.length,1,1,fp) != 1) return false;
+	int codingLength = raw[header.length++];
+	if((int) fread(raw+header.length,1,codingLength,fp) != codingLength) return false;
+	header.length += codingLength;
+	return true;
+}
+
+static int dtypeSize(char dtype)
+{
+	switch(dtype){
+	case 'b': case 'B': case 'c': case '?': return 1;
+	case 'h': case 'H': return 2;
+	case 'i': case 'I': case 'f': return 4;
+	case 'q': case 'Q': case 'd': return 8;
+	default: return 0;
+	}
+}
+
+static bool readIndexDict(FILE * fp, UfmfIndexEntry &dict)
+{
+	unsigned char nKeys;
+	dict.isDict = true;
+	if(fread(&nKeys,1,1,fp) != 1) return false;
+	dict.children.resize(nKeys);
+
+	for(int i = 0; i < nKeys; i++){
+		UfmfIndexEntry &entry = dict.children[i];
+		unsigned short nameLength;
+		char type;
+		if(fread(&nameLength,2,1,fp) != 1) return false;
+		entry.name.resize(nameLength);
+		if(nameLength > 0 && fread(&entry.name[0],1,nameLength,fp) != nameLength) return false;
+		if(fread(&type,1,1,fp) != 1) return false;
+
+		if(type == 'd'){
+			if(!readIndexDict(fp,entry)) return false;
+		}
+		else if(type == 'a'){
+			UINT32 nBytes;
+			entry.isDict = false;
+			if(fread(&entry.dtype,1,1,fp) != 1 || dtypeSize(entry.dtype) == 0) return false;
+			if(fread(&nBytes,4,1,fp) != 1) return false;
+			entry.data.resize(nBytes);
+			if(nBytes > 0 && fread(&entry.data[0],1,nBytes,fp) != nBytes) return false;
+		}
+		else{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool writeIndexDict(FILE * fp, const UfmfIndexEntry &dict)
+{
+	unsigned char nKeys = (unsigned char) dict.children.size();
+	if(fwrite("d",1,1,fp) != 1 || fwrite(&nKeys,1,1,fp) != 1) return false;
+
+	for(int i = 0; i < nKeys; i++){
+		const UfmfIndexEntry &entry = dict.children[i];
+		unsigned short nameLength = (unsigned short) entry.name.size();
+		if(fwrite(&nameLength,2,1,fp) != 1) return false;
+		if(nameLength > 0 && fwrite(entry.name.data(),1,nameLength,fp) != nameLength) return false;
+
+		if(entry.isDict){
+			if(!writeIndexDict(fp,entry)) return false;
+		}
+		else{
+			UINT32 nBytes = (UINT32) entry.data.size();
+			if(fwrite("a",1,1,fp) != 1 || fwrite(&entry.dtype,1,1,fp) != 1) return false;
+			if(fwrite(&nBytes,4,1,fp) != 1) return false;
+			if(nBytes > 0 && fwrite(&entry.data[0],1,nBytes,fp) != nBytes) return false;
+		}
+	}
+	return true;
+}
+
+// adds offset to every element of a "loc" array, which holds file positions
+static bool offsetLocations(UfmfIndexEntry &entry, INT64 offset)
+{
+	int size = dtypeSize(entry.dtype);
+	unsigned char * p = entry.data.empty() ? NULL : &entry.data[0];
+	size_t n = entry.data.size() / size;
+
+	for(size_t i = 0; i < n; i++, p += size){
+		if(size == 8){
+			INT64 loc;
+			memcpy(&loc,p,8);
+			loc += offset;
+			memcpy(p,&loc,8);
+		}
+		else if(size == 4 && (entry.dtype == 'i' || entry.dtype == 'I')){
+			INT64 loc;
+			if(entry.dtype == 'i'){
+				INT32 loc32;
+				memcpy(&loc32,p,4);
+				loc = loc32;
+			}
+			else{
+				UINT32 loc32;
+				memcpy(&loc32,p,4);
+				loc = loc32;
+			}
+			loc += offset;
+			if(loc < 0 || loc > 0x7fffffff) return false;
+			INT32 loc32 = (INT32) loc;
+			memcpy(p,&loc32,4);
+		}
+		else{
+			return false;
+		}
+	}
+	return true;
+}
+
+// appends the fragment's index to merged, shifting locations by offset
+static bool mergeIndex(UfmfIndexEntry &merged, UfmfIndexEntry &fragment, INT64 offset)
+{
+	for(size_t i = 0; i < fragment.children.size(); i++){
+		UfmfIndexEntry &entry = fragment.children[i];
+		if(!entry.isDict && entry.name == "loc" && !offsetLocations(entry,offset)){
+			return false;
+		}
+
+		size_t j;
+		for(j = 0; j < merged.children.size(); j++){
+			if(merged.children[j].name == entry.name) break;
+		}
+		if(j == merged.children.size()){
+			if(entry.isDict){
+				UfmfIndexEntry empty;
+				empty.name = entry.name;
+				empty.isDict = true;
+				merged.children.push_back(empty);
+				if(!mergeIndex(merged.children.back(),entry,offset)) return false;
+			}
+			else{
+				merged.children.push_back(entry);
+			}
+			continue;
+		}
+
+		UfmfIndexEntry &target = merged.children[j];
+		if(target.isDict != entry.isDict) return false;
+		if(entry.isDict){
+			if(!mergeIndex(target,entry,offset)) return false;
+		}
+		else{
+			if(target.dtype != entry.dtype) return false;
+			target.data.insert(target.data.end(),entry.data.begin(),entry.data.end());
+		}
+	}
+	return true;
+}
+
+static bool copyBytes(FILE * in, FILE * out, UINT64 nBytes, unsigned char * buffer)
+{
+	while(nBytes > 0){
+		size_t n = nBytes < STITCHCOPYBUFFERSIZE ? (size_t) nBytes : STITCHCOPYBUFFERSIZE;
+		if(fread(buffer,1,n,in) != n || fwrite(buffer,1,n,out) != n){
+			return false;
+		}
+		nBytes -= n;
+	}
+	return true;
+}
+
+bool stitchUfmf(const char * outFileName, char ** fragmentFileNames, int nFragments, FILE * logFID)
+{
+	FILE * out = fopen(outFileName,"wb");
+	if(out == NULL){
+		fprintf(logFID,"Error opening %s for writing\n",outFileName);
+		return false;
+	}
+
+	unsigned char * buffer = (unsigned char*) malloc(STITCHCOPYBUFFERSIZE);
+	UfmfHeader first;
+	UfmfIndexEntry index;
+	index.isDict = true;
+	bool success = buffer != NULL;
+
+	for(int i = 0; i < nFragments && success; i++){
+		FILE * in = fopen(fragmentFileNames[i],"rb");
+		UfmfHeader header;
+		if(in == NULL || !readHeader(in,header)){
+			fprintf(logFID,"Error reading ufmf header from %s\n",fragmentFileNames[i]);
+			if(in != NULL) fclose(in);
+			success = false;
+			break;
+		}
+
+		if(i == 0){
+			// the output keeps the header of the first fragment, with the index
+			// location filled in at the end
+			first = header;
+			success = fwrite(first.raw,1,first.length,out) == (size_t) first.length;
+		}
+		else if(header.length != first.length || memcmp(header.raw+4,first.raw+4,4) != 0 ||
+			memcmp(header.raw+16+4,first.raw+16+4,header.length-16-4) != 0){
+			fprintf(logFID,"%s does not have the same ufmf version and coding as %s\n",fragmentFileNames[i],fragmentFileNames[0]);
+			success = false;
+		}
+		for(int k = 0; k < 2; k++){
+			if(header.maxSize[k] > first.maxSize[k]) first.maxSize[k] = header.maxSize[k];
+		}
+
+		// frames and keyframes are copied unchanged; only their index
+		// locations move
+		INT64 offset = (INT64) ufmfTell(out) - header.length;
+		UfmfIndexEntry fragmentIndex;
+		unsigned char chunkType;
+		if(success){
+			success = copyBytes(in,out,header.indexLocation - header.length,buffer) &&
+				fread(&chunkType,1,1,in) == 1 && chunkType == UFMFINDEXCHUNK &&
+				fread(&chunkType,1,1,in) == 1 && chunkType == 'd' &&
+				readIndexDict(in,fragmentIndex) && mergeIndex(index,fragmentIndex,offset);
+			if(!success){
+				fprintf(logFID,"Error copying frames and index of %s\n",fragmentFileNames[i]);
+			}
+		}
+		fclose(in);
+	}
+
+	if(success){
+		unsigned char chunkType = UFMFINDEXCHUNK;
+		UINT64 indexLocation = (UINT64) ufmfTell(out);
+		success = fwrite(&chunkType,1,1,out) == 1 && writeIndexDict(out,index) &&
+			ufmfSeek(out,UFMFINDEXLOCOFFSET,SEEK_SET) == 0 && fwrite(&indexLocation,8,1,out) == 1 &&
+			ufmfSeek(out,UFMFMAXSIZEOFFSET,SEEK_SET) == 0 && fwrite(first.maxSize,2,2,out) == 2;
+		if(!success){
+			fprintf(logFID,"Error writing index of %s\n",outFileName);
+		}
+	}
+
+	if(fclose(out) != 0){
+		success = false;
+	}
+	if(buffer != NULL){
+		free(buffer);
+	}
+	return success;
+}
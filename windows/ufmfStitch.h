@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdio.h>
+
+// Joins ufmf files that hold consecutive stretches of the same video into a
+// single ufmf. The frame and keyframe chunks of each fragment are copied
+// unchanged, one after the other, behind the header of the first fragment.
+// Their index entries are concatenated and their locations shifted to the new
+// offsets. Fragments must share version, coding and frame size, and their
+// timestamps must increase from one fragment to the next. Supports ufmf
+// versions 3 and 4
+bool stitchUfmf(const char * outFileName, char ** fragmentFileNames, int nFragments, FILE * logFID);
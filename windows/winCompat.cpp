@@ -0,0 +1,154 @@
+#ifndef _WIN32
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "winCompat.h"
+
+typedef enum {
+	CompatHandleSemaphore,
+	CompatHandleThread
+} CompatHandleType;
+
+typedef struct {
+	CompatHandleType type;
+
+	// semaphore
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	LONG count;
+	LONG maximumCount;
+
+	// thread
+	pthread_t thread;
+	LPTHREAD_START_ROUTINE startAddress;
+	LPVOID parameter;
+} CompatHandle;
+
+HANDLE CreateSemaphore(void * attributes, LONG initialCount, LONG maximumCount, const char * name)
+{
+	CompatHandle * h = new CompatHandle;
+	h->type = CompatHandleSemaphore;
+	pthread_mutex_init(&h->mutex,NULL);
+	pthread_cond_init(&h->cond,NULL);
+	h->count = initialCount;
+	h->maximumCount = maximumCount;
+	return h;
+}
+
+BOOL ReleaseSemaphore(HANDLE semaphore, LONG releaseCount, LONG * previousCount)
+{
+	CompatHandle * h = (CompatHandle*) semaphore;
+	BOOL success = TRUE;
+
+	pthread_mutex_lock(&h->mutex);
+	if(previousCount != NULL){
+		*previousCount = h->count;
+	}
+	// like Windows, refuse to go over the maximum count
+	if(h->count + releaseCount > h->maximumCount){
+		success = FALSE;
+	}
+	else{
+		h->count += releaseCount;
+		pthread_cond_broadcast(&h->cond);
+	}
+	pthread_mutex_unlock(&h->mutex);
+	return success;
+}
+
+static void * compatThreadStart(void * param)
+{
+	CompatHandle * h = (CompatHandle*) param;
+	h->startAddress(h->parameter);
+	return NULL;
+}
+
+HANDLE CreateThread(void * attributes, size_t stackSize, LPTHREAD_START_ROUTINE startAddress, LPVOID parameter, DWORD creationFlags, DWORD * threadId)
+{
+	CompatHandle * h = new CompatHandle;
+	h->type = CompatHandleThread;
+	h->startAddress = startAddress;
+	h->parameter = parameter;
+	if(pthread_create(&h->thread,NULL,compatThreadStart,h) != 0){
+		delete h;
+		return NULL;
+	}
+	if(threadId != NULL){
+		*threadId = 0;
+	}
+	return h;
+}
+
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds)
+{
+	CompatHandle * h = (CompatHandle*) handle;
+
+	if(h->type == CompatHandleThread){
+		if(milliseconds != INFINITE || pthread_join(h->thread,NULL) != 0){
+			return WAIT_FAILED;
+		}
+		return WAIT_OBJECT_0;
+	}
+
+	struct timespec deadline;
+	if(milliseconds != INFINITE){
+		clock_gettime(CLOCK_REALTIME,&deadline);
+		deadline.tv_sec += milliseconds / 1000;
+		deadline.tv_nsec += (long) (milliseconds % 1000) * 1000000L;
+		if(deadline.tv_nsec >= 1000000000L){
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+
+	DWORD result = WAIT_OBJECT_0;
+	pthread_mutex_lock(&h->mutex);
+	while(h->count == 0){
+		if(milliseconds == INFINITE){
+			pthread_cond_wait(&h->cond,&h->mutex);
+		}
+		else if(pthread_cond_timedwait(&h->cond,&h->mutex,&deadline) == ETIMEDOUT){
+			result = WAIT_TIMEOUT;
+			break;
+		}
+	}
+	if(result == WAIT_OBJECT_0){
+		h->count--;
+	}
+	pthread_mutex_unlock(&h->mutex);
+	return result;
+}
+
+BOOL CloseHandle(HANDLE handle)
+{
+	CompatHandle * h = (CompatHandle*) handle;
+	if(h->type == CompatHandleSemaphore){
+		pthread_cond_destroy(&h->cond);
+		pthread_mutex_destroy(&h->mutex);
+	}
+	delete h;
+	return TRUE;
+}
+
+void Sleep(DWORD milliseconds)
+{
+	usleep((useconds_t) milliseconds * 1000);
+}
+
+void GetSystemInfo(SYSTEM_INFO * info)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	info->dwNumberOfProcessors = n > 0 ? (DWORD) n : 1;
+}
+
+int MessageBox(void * owner, const char * text, const char * caption, unsigned int type)
+{
+	fprintf(stderr,"%s\n",text);
+	return IDNO;
+}
+
+#endif
@@ -0,0 +1,92 @@
+#pragma once
+
+// winCompat provides the small part of the Win32 API that any2ufmf uses for
+// threads and synchronization, so that its sources also compile on Linux.
+// Linking there still needs a Linux ufmfWriter, see the Makefile. On Windows
+// it just includes windows.h.
+// Sizes that must be exact use the Win32 integer types (UINT32, UINT64, ...),
+// which are defined here from stdint.h on Linux
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+typedef int32_t INT32;
+typedef uint32_t UINT32;
+typedef int64_t INT64;
+typedef uint64_t UINT64;
+typedef void * HANDLE;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef int BOOL;
+typedef void * LPVOID;
+typedef const wchar_t * LPCWSTR;
+typedef DWORD (*LPTHREAD_START_ROUTINE)(LPVOID);
+
+#define WINAPI
+#define TRUE 1
+#define FALSE 0
+#define INFINITE 0xFFFFFFFF
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+#define WAIT_FAILED 0xFFFFFFFF
+
+#define MB_OK 0
+#define MB_YESNO 4
+#define IDNO 7
+#define IDYES 6
+
+#ifndef ARRAYSIZE
+#define ARRAYSIZE(a) (sizeof(a)/sizeof((a)[0]))
+#endif
+
+typedef struct {
+	LPCWSTR pszName;
+	LPCWSTR pszSpec;
+} COMDLG_FILTERSPEC;
+
+HANDLE CreateSemaphore(void * attributes, LONG initialCount, LONG maximumCount, const char * name);
+BOOL ReleaseSemaphore(HANDLE semaphore, LONG releaseCount, LONG * previousCount);
+HANDLE CreateThread(void * attributes, size_t stackSize, LPTHREAD_START_ROUTINE startAddress, LPVOID parameter, DWORD creationFlags, DWORD * threadId);
+// works on semaphores and threads. timeouts are only supported for semaphores
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds);
+BOOL CloseHandle(HANDLE handle);
+void Sleep(DWORD milliseconds);
+
+// only the number of processors is filled in
+typedef struct {
+	DWORD dwNumberOfProcessors;
+} SYSTEM_INFO;
+void GetSystemInfo(SYSTEM_INFO * info);
+
+// there is no message box without a display, so the text goes to stderr
+int MessageBox(void * owner, const char * text, const char * caption, unsigned int type);
+
+inline LONG InterlockedExchange(volatile LONG * target, LONG value)
+{
+	__sync_synchronize();
+	return __sync_lock_test_and_set(target,value);
+}
+
+inline LONG InterlockedIncrement(volatile LONG * target)
+{
+	return __sync_add_and_fetch(target,1);
+}
+
+inline LONG InterlockedDecrement(volatile LONG * target)
+{
+	return __sync_sub_and_fetch(target,1);
+}
+
+inline LONG InterlockedCompareExchange(volatile LONG * target, LONG exchange, LONG comparand)
+{
+	return __sync_val_compare_and_swap(target,comparand,exchange);
+}
+
+#endif